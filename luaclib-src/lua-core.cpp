@@ -11,6 +11,7 @@ extern "C" {
 #include <cstdlib>
 #include <cassert>
 #include <cinttypes>
+#include <vector>
 
 //
 static const char* _get_dst_svc_handle_string(lua_State* L, int index)
@@ -36,9 +37,18 @@ static int _send_message(lua_State* L, int src_svc_handle, int message_type_idx)
     auto svc_ctx = (skynet::service_context*)lua_touserdata(L, lua_upvalueindex(1));
 
     // arg 1 - destination service handle (integer | string)
-    uint32_t dst_svc_handle = (uint32_t)lua_tointeger(L, 1);
+    uint32_t dst_svc_handle = 0;
     const char* dst_svc_handle_string = nullptr;
-    if (dst_svc_handle == 0)
+    // service name or address string, skip the string to number conversion
+    if (lua_type(L, 1) == LUA_TSTRING)
+    {
+        const char* dst_string = lua_tostring(L, 1);
+        if (dst_string[0] == '.' || dst_string[0] == ':')
+            dst_svc_handle_string = dst_string;
+    }
+    if (dst_svc_handle_string == nullptr)
+        dst_svc_handle = (uint32_t)lua_tointeger(L, 1);
+    if (dst_svc_handle == 0 && dst_svc_handle_string == nullptr)
     {
         if (lua_type(L, 1) == LUA_TNUMBER)
         {
@@ -101,11 +111,27 @@ static int _send_message(lua_State* L, int src_svc_handle, int message_type_idx)
             return 1;
         }
 
+        // destination mailbox is full
+        if (session_id == -3)
+        {
+            lua_pushboolean(L, 0);
+            lua_pushliteral(L, "mailbox full");
+            return 2;
+        }
+
         // send to invalid address, todo: maybe throw an error would be better
         return 0;
     }
     lua_pushinteger(L, session_id);
 
+    // destination mailbox is full (throttle policy), signal the sender
+    if (svc_ctx->is_send_throttled_)
+    {
+        svc_ctx->is_send_throttled_ = false;
+        lua_pushliteral(L, "throttle");
+        return 2;
+    }
+
     return 1;
 }
 
@@ -150,6 +176,285 @@ static int l_redirect(lua_State* L)
     return _send_message(L, src_svc_handle, 3);
 }
 
+// check a batch message (table at the top of the stack), raise the error before any lightuserdata message is taken
+static void _check_batch_item(lua_State* L, int i)
+{
+    int idx = lua_gettop(L);
+    int isnum = 0;
+
+    // 1 - destination service handle (integer | string)
+    int dst_type = lua_rawgeti(L, idx, 1);
+    if (dst_type == LUA_TNUMBER)
+    {
+        if (lua_tointegerx(L, -1, &isnum) == 0)
+            luaL_error(L, "Invalid batch message #%d: destination service handle 0", i);
+    }
+    else if (dst_type != LUA_TSTRING)
+    {
+        luaL_error(L, "Invalid batch message #%d: dest address type (%s) must be a string or number.", i, lua_typename(L, dst_type));
+    }
+
+    // 2 - protocol type
+    lua_rawgeti(L, idx, 2);
+    lua_tointegerx(L, -1, &isnum);
+    if (!isnum)
+        luaL_error(L, "Invalid batch message #%d: protocol type", i);
+
+    // 3 - session id (nil | integer)
+    if (lua_rawgeti(L, idx, 3) != LUA_TNIL)
+    {
+        lua_tointegerx(L, -1, &isnum);
+        if (!isnum)
+            luaL_error(L, "Invalid batch message #%d: session", i);
+    }
+
+    // 4 - message (string | lightuserdata, integer len)
+    int msg_type = lua_rawgeti(L, idx, 4);
+    if (msg_type == LUA_TLIGHTUSERDATA)
+    {
+        lua_rawgeti(L, idx, 5);
+        lua_tointegerx(L, -1, &isnum);
+        if (!isnum)
+            luaL_error(L, "Invalid batch message #%d: message size", i);
+    }
+    else if (msg_type != LUA_TSTRING)
+    {
+        luaL_error(L, "Invalid batch message #%d: invalid param %s", i, lua_typename(L, msg_type));
+    }
+
+    lua_settop(L, idx);
+}
+
+/**
+ * send messages in batch, grouped per destination service in core
+ *
+ * arguments:
+ * 1 messages                    - table, array of { dst, protocol type, session, message (string | lightuserdata, integer len) }
+ *
+ * outputs:
+ * the number of messages sent   - integer
+ *
+ * lua examples:
+ * c.send_batch({ { addr1, proto.id, 0, msg1 }, { addr2, proto.id, 0, proto.pack(...) } })
+ * ...
+ */
+static int l_send_batch(lua_State* L)
+{
+    auto svc_ctx = (skynet::service_context*)lua_touserdata(L, lua_upvalueindex(1));
+
+    luaL_checktype(L, 1, LUA_TTABLE);
+    int n = (int)lua_rawlen(L, 1);
+
+    // check all messages first, an error never leaves the lightuserdata messages half taken
+    for (int i = 0; i < n; i++)
+    {
+        if (lua_rawgeti(L, 1, i + 1) != LUA_TTABLE)
+        {
+            luaL_error(L, "Invalid batch message #%d: %s", i + 1, luaL_typename(L, -1));
+        }
+        _check_batch_item(L, i + 1);
+        lua_settop(L, 1);
+    }
+
+    std::vector<skynet::service_manager::send_item> items(n);
+    for (int i = 0; i < n; i++)
+    {
+        lua_rawgeti(L, 1, i + 1);
+        int idx = lua_gettop(L);
+        auto& item = items[i];
+
+        // 1 - destination service handle (integer | string)
+        if (lua_rawgeti(L, idx, 1) == LUA_TNUMBER)
+            item.dst_svc_handle = (uint32_t)lua_tointeger(L, -1);
+        else
+            item.dst_svc_handle = skynet::service_manager::instance()->query_by_name(svc_ctx, lua_tostring(L, -1));
+
+        // 2 - protocol type
+        lua_rawgeti(L, idx, 2);
+        item.svc_msg_type = lua_tointeger(L, -1);
+
+        // 3 - session id, nil means need alloc a new session id
+        if (lua_rawgeti(L, idx, 3) == LUA_TNIL)
+            item.svc_msg_type |= MESSAGE_TAG_ALLOC_SESSION;
+        else
+            item.session_id = lua_tointeger(L, -1);
+
+        // 4 - message (string | lightuserdata)
+        if (lua_rawgeti(L, idx, 4) == LUA_TSTRING)
+        {
+            size_t len = 0;
+            const char* msg = lua_tolstring(L, -1, &len);
+            item.msg = len == 0 ? nullptr : (void*)msg;
+            item.msg_sz = len;
+        }
+        else
+        {
+            item.msg = lua_touserdata(L, -1);
+            lua_rawgeti(L, idx, 5);
+            item.msg_sz = lua_tointeger(L, -1);
+            item.svc_msg_type |= MESSAGE_TAG_DONT_COPY;
+        }
+
+        // string message is copied in send_batch(), it is referenced by the messages table until then.
+        lua_settop(L, 1);
+    }
+
+    int sent = skynet::service_manager::instance()->send_batch(svc_ctx, 0, items);
+    lua_pushinteger(L, sent);
+
+    return 1;
+}
+
+/**
+ * query the mailbox pressure of a service
+ *
+ * arguments:
+ * 1 service handle              - integer
+ *
+ * outputs:
+ * mailbox length                - integer, the number of pending messages (normal lane)
+ * mailbox capacity              - integer, 0: unlimited
+ * (nothing if the service not exists)
+ *
+ * lua examples:
+ * local len, cap = c.pressure(addr)
+ * ...
+ */
+static int l_pressure(lua_State* L)
+{
+    auto svc_handle = (uint32_t)luaL_checkinteger(L, 1);
+
+    int length = 0;
+    int capacity = 0;
+    if (!skynet::service_manager::instance()->pressure(svc_handle, length, capacity))
+        return 0;
+
+    lua_pushinteger(L, length);
+    lua_pushinteger(L, capacity);
+
+    return 2;
+}
+
+/**
+ * query the outstanding calls to a service (overload signal)
+ *
+ * arguments:
+ * 1 service handle              - integer
+ *
+ * outputs:
+ * outstanding calls             - integer, calls sent to the service, not responded or expired
+ * (nothing if the service not exists)
+ *
+ * lua examples:
+ * local n = c.call_inbound(addr)
+ * ...
+ */
+static int l_call_inbound(lua_State* L)
+{
+    auto svc_handle = (uint32_t)luaL_checkinteger(L, 1);
+
+    int count = skynet::service_manager::instance()->call_inbound(svc_handle);
+    if (count < 0)
+        return 0;
+
+    lua_pushinteger(L, count);
+
+    return 1;
+}
+
+/**
+ * snapshot the runtime stat of all services (no message to the services)
+ *
+ * outputs:
+ * stat table                    - table, key: service handle, value: { message = n, cpu = seconds, mqlen = n, overload = n, mem = kb }
+ *                                 cpu is 0 if profile is off, mem is 0 for a service without lua vm
+ *
+ * lua examples:
+ * local all = c.stat_all()
+ * ...
+ */
+static int l_stat_all(lua_State* L)
+{
+    std::vector<skynet::service_manager::service_stat> stats;
+    skynet::service_manager::instance()->stat_all(stats);
+
+    lua_createtable(L, 0, (int)stats.size());
+    for (auto& stat : stats)
+    {
+        lua_createtable(L, 0, 5);
+        lua_pushinteger(L, stat.message_count);
+        lua_setfield(L, -2, "message");
+        lua_pushnumber(L, (double)stat.cpu_cost / 1000000.0);
+        lua_setfield(L, -2, "cpu");
+        lua_pushinteger(L, stat.mqlen);
+        lua_setfield(L, -2, "mqlen");
+        lua_pushinteger(L, (lua_Integer)stat.overload_count);
+        lua_setfield(L, -2, "overload");
+        lua_pushnumber(L, (double)stat.mem / 1024.0);
+        lua_setfield(L, -2, "mem");
+
+        lua_rawseti(L, -2, stat.svc_handle);
+    }
+
+    return 1;
+}
+
+/**
+ * select a member of a service pool
+ *
+ * arguments:
+ * 1 pool name                   - string, ".name"
+ * 2 sticky key (optional)       - integer or string, same key, same member (while the members are unchanged)
+ *
+ * outputs:
+ * service handle                - integer, the least loaded member (or the member of the key)
+ * (nothing if the pool not exists)
+ *
+ * lua examples:
+ * local addr = c.pool_select(".db")
+ * local addr = c.pool_select(".db", uid)
+ * ...
+ */
+static int l_pool_select(lua_State* L)
+{
+    const char* name = luaL_checkstring(L, 1);
+    if (name[0] != '.')
+        return luaL_error(L, "Invalid pool name %s", name);
+
+    uint32_t svc_handle = 0;
+    if (lua_isnoneornil(L, 2))
+    {
+        svc_handle = skynet::service_manager::instance()->pool_select(name + 1);
+    }
+    else
+    {
+        uint64_t key = 0;
+        if (lua_isinteger(L, 2))
+        {
+            key = (uint64_t)lua_tointeger(L, 2);
+        }
+        else
+        {
+            // FNV-1a
+            size_t sz = 0;
+            const char* str = luaL_checklstring(L, 2, &sz);
+            key = 14695981039346656037ULL;
+            for (size_t i = 0; i < sz; i++)
+            {
+                key = (key ^ (uint8_t)str[i]) * 1099511628211ULL;
+            }
+        }
+        svc_handle = skynet::service_manager::instance()->pool_select_sticky(name + 1, key);
+    }
+
+    if (svc_handle == 0)
+        return 0;
+
+    lua_pushinteger(L, svc_handle);
+
+    return 1;
+}
+
 /**
  * exec service command
  *
@@ -353,6 +658,11 @@ static int _cb(skynet::service_context* svc_ctx, void* ud, int type, int session
 
     int trace = 1;
     int r = lua_pcall(L, 5, 0, trace);
+
+    // publish the lua vm memory (read by service_manager::stat_all)
+    uint64_t mem = (uint64_t)lua_gc(L, LUA_GCCOUNT, 0) * 1024 + lua_gc(L, LUA_GCCOUNTB, 0);
+    svc_ctx->mem_usage_.store(mem, std::memory_order_relaxed);
+
     if (r == LUA_OK)
     {
         return 0;
@@ -426,7 +736,7 @@ static int l_set_service_callback(lua_State* L)
     // forward mode
     if (forward)
     {
-        svc_ctx->set_callback(_forward_cb, gL);
+        svc_ctx->set_callback(_forward_cb, gL, true);
     }
     else
     {
@@ -436,6 +746,28 @@ static int l_set_service_callback(lua_State* L)
     return 0;
 }
 
+/**
+ * set the deadline of new calls (the call gets an error when the deadline is reached)
+ *
+ * arguments:
+ * 1 deadline                    - integer, ticks (1 tick = 10ms), 0: no deadline
+ *
+ * outputs:
+ * 1) the previous deadline      - integer
+ *
+ * lua examples:
+ * local prev = c.call_timeout(100)
+ */
+static int l_call_timeout(lua_State* L)
+{
+    // service context upvalue
+    auto svc_ctx = (skynet::service_context*)lua_touserdata(L, lua_upvalueindex(1));
+
+    int ticks = (int)luaL_checkinteger(L, 1);
+    lua_pushinteger(L, svc_ctx->sessions_.set_call_timeout(ticks));
+    return 1;
+}
+
 /**
  * generate a new session id
  *
@@ -832,10 +1164,12 @@ static int l_pack_string(lua_State* L)
  * arguments:
  * 1 message        - string | lightuserdata
  * 2 message size   - integer
+ * 3 message type   - integer (optional), the multicast message refers to a shared package
  *
  * lua examples:
  * skynet.trash = assert(c.trash)
  * c.trash(msg, sz)
+ * c.trash(msg, sz, svc_msg_type)
  */
 static int l_trash(lua_State* L)
 {
@@ -847,7 +1181,10 @@ static int l_trash(lua_State* L)
     {
         char* msg = (char*)lua_touserdata(L, 1);
         luaL_checkinteger(L, 2);
-        delete[] msg;
+        if (luaL_optinteger(L, 3, 0) == skynet::SERVICE_MSG_TYPE_MULTICAST)
+            skynet::service_multicast::release_package((skynet::multicast_package*)msg);
+        else
+            delete[] msg;
     }
     else
     {
@@ -904,11 +1241,13 @@ LUAMOD_API int luaopen_skynet_core(lua_State* L)
     luaL_Reg core_funcs_1[] = {
         { "send",           l_send },
         { "redirect",       l_redirect },
+        { "send_batch",     l_send_batch },
         { "command",        l_service_command },
         { "intcommand",     l_service_command_int },
         { "addresscommand", l_service_command_address },
         { "callback",       l_set_service_callback },
         { "new_session_id", l_new_session_id },
+        { "call_timeout",   l_call_timeout },
         { "log_trace",      l_log_trace },
         { "log_debug",      l_log_debug },
         { "log_info",       l_log_info },
@@ -928,6 +1267,10 @@ LUAMOD_API int luaopen_skynet_core(lua_State* L)
         { "trash",       l_trash },
         { "now_ticks",   l_now_ticks },
         { "hpc",         l_hpc },
+        { "pressure",    l_pressure },
+        { "pool_select", l_pool_select },
+        { "call_inbound", l_call_inbound },
+        { "stat_all",    l_stat_all },
 
         { nullptr,       nullptr },
     };
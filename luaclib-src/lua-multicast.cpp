@@ -0,0 +1,197 @@
+#define LUA_LIB
+
+#include "skynet.h"
+
+extern "C" {
+#include <lua.h>
+#include <lauxlib.h>
+}
+
+#include <cstring>
+
+/**
+ * create a channel
+ *
+ * outputs:
+ * channel id           - integer
+ */
+static int l_new(lua_State* L)
+{
+    uint32_t channel = skynet::service_multicast::instance()->new_channel();
+    lua_pushinteger(L, channel);
+
+    return 1;
+}
+
+/**
+ * delete a channel
+ *
+ * arguments:
+ * 1 channel id         - integer
+ */
+static int l_delete(lua_State* L)
+{
+    auto channel = (uint32_t)luaL_checkinteger(L, 1);
+    lua_pushboolean(L, skynet::service_multicast::instance()->delete_channel(channel));
+
+    return 1;
+}
+
+/**
+ * subscribe a channel
+ *
+ * arguments:
+ * 1 channel id         - integer
+ * 2 service handle     - integer, optional (default: self)
+ */
+static int l_subscribe(lua_State* L)
+{
+    auto svc_ctx = (skynet::service_context*)lua_touserdata(L, lua_upvalueindex(1));
+
+    auto channel = (uint32_t)luaL_checkinteger(L, 1);
+    auto svc_handle = (uint32_t)luaL_optinteger(L, 2, svc_ctx->svc_handle_);
+    lua_pushboolean(L, skynet::service_multicast::instance()->subscribe(channel, svc_handle));
+
+    return 1;
+}
+
+/**
+ * unsubscribe a channel
+ *
+ * arguments:
+ * 1 channel id         - integer
+ * 2 service handle     - integer, optional (default: self)
+ */
+static int l_unsubscribe(lua_State* L)
+{
+    auto svc_ctx = (skynet::service_context*)lua_touserdata(L, lua_upvalueindex(1));
+
+    auto channel = (uint32_t)luaL_checkinteger(L, 1);
+    auto svc_handle = (uint32_t)luaL_optinteger(L, 2, svc_ctx->svc_handle_);
+    lua_pushboolean(L, skynet::service_multicast::instance()->unsubscribe(channel, svc_handle));
+
+    return 1;
+}
+
+/**
+ * publish a message to all subscribers of the channel
+ *
+ * arguments:
+ * 1 channel id         - integer
+ * 2 message            - string | lightuserdata (message_ptr, integer len), lightuserdata is owned by multicast
+ *
+ * outputs:
+ * the number of subscribers received, -1 if channel not exists
+ */
+static int l_publish(lua_State* L)
+{
+    auto svc_ctx = (skynet::service_context*)lua_touserdata(L, lua_upvalueindex(1));
+
+    auto channel = (uint32_t)luaL_checkinteger(L, 1);
+
+    void* data = nullptr;
+    size_t size = 0;
+    int msg_type = lua_type(L, 2);
+    if (msg_type == LUA_TSTRING)
+    {
+        const char* msg = lua_tolstring(L, 2, &size);
+        char* new_msg = new char[size + 1];
+        ::memcpy(new_msg, msg, size);
+        new_msg[size] = '\0';
+        data = new_msg;
+    }
+    else if (msg_type == LUA_TLIGHTUSERDATA)
+    {
+        data = lua_touserdata(L, 2);
+        size = luaL_checkinteger(L, 3);
+    }
+    else
+    {
+        return luaL_error(L, "Invalid param %s", lua_typename(L, msg_type));
+    }
+
+    int count = skynet::service_multicast::instance()->publish(svc_ctx->svc_handle_, channel, data, size);
+    lua_pushinteger(L, count);
+
+    return 1;
+}
+
+/**
+ * unpack a multicast message
+ *
+ * arguments:
+ * 1 message            - lightuserdata (multicast package)
+ * 2 message size       - integer
+ *
+ * outputs:
+ * channel id           - integer
+ * payload              - lightuserdata (valid until the message callback return)
+ * payload size         - integer
+ */
+static int l_unpack(lua_State* L)
+{
+    auto pkg = (skynet::multicast_package*)lua_touserdata(L, 1);
+    if (pkg == nullptr)
+    {
+        return luaL_error(L, "Invalid multicast package");
+    }
+
+    lua_pushinteger(L, pkg->channel);
+    lua_pushlightuserdata(L, pkg->data);
+    lua_pushinteger(L, (lua_Integer)pkg->size);
+
+    return 3;
+}
+
+/**
+ * the number of packages not released by all subscribers yet
+ *
+ * outputs:
+ * package count        - integer
+ */
+static int l_packages(lua_State* L)
+{
+    lua_pushinteger(L, skynet::service_multicast::package_count());
+
+    return 1;
+}
+
+/**
+ * skynet luaclib - skynet.multicast.core
+ */
+#if __cplusplus
+extern "C" {
+#endif
+
+LUAMOD_API int luaopen_skynet_multicast_core(lua_State* L)
+{
+    luaL_checkversion(L);
+
+    luaL_Reg l[] = {
+        { "new",            l_new },
+        { "delete",         l_delete },
+        { "subscribe",      l_subscribe },
+        { "unsubscribe",    l_unsubscribe },
+        { "publish",        l_publish },
+        { "unpack",         l_unpack },
+        { "packages",       l_packages },
+        { nullptr,          nullptr },
+    };
+
+    luaL_newlibtable(L, l);
+
+    // service_context upvalue (see: snlua_service::init_lua_cb())
+    lua_getfield(L, LUA_REGISTRYINDEX, "service_context");
+    auto svc_ctx = (skynet::service_context*)lua_touserdata(L, -1);
+    if (svc_ctx == nullptr)
+    {
+        return luaL_error(L, "[skynet.multicast.core] Init skynet service context first");
+    }
+    luaL_setfuncs(L, l, 1);
+
+    return 1;
+}
+
+#if __cplusplus
+}
+#endif
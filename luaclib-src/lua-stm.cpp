@@ -12,6 +12,7 @@ extern "C" {
 
 #include <atomic>
 #include <shared_mutex>
+#include <mutex>
 
 struct stm_copy
 {
@@ -179,17 +179,21 @@ local suspend                           -- thread suspend function
 ----- monitor exit
 
 local error_queue = {}
+local timeout_session_map = {}    -- call sessions reached the deadline (see skynet.timed_call)
+local DEADLINE_PAYLOAD = "timeout"  -- the payload of the deadline error (see service_session)
 
 local function dispatch_error_queue()
     local session_id = table_remove(error_queue, 1)
     if session_id then
         local thread = session_thread_map[session_id]
         session_thread_map[session_id] = nil
-        return suspend(thread, thread_resume(thread, false))
+        local is_timeout = timeout_session_map[session_id]
+        timeout_session_map[session_id] = nil
+        return suspend(thread, thread_resume(thread, false, is_timeout))
     end
 end
 
-local function _error_dispatch(error_session_id, error_src_svc_handle)
+local function _error_dispatch(error_session_id, error_src_svc_handle, msg, msg_sz)
     skynet.ignoreret()    -- don't return for error
     if error_session_id == 0 then
         -- error_src_svc_handle is down, clear unreponse set
@@ -207,6 +211,9 @@ local function _error_dispatch(error_session_id, error_src_svc_handle)
         -- capture an error for error_session_id
         if watching_session_map[error_session_id] then
             table_insert(error_queue, error_session_id)
+            if msg_sz == #DEADLINE_PAYLOAD and skynet_core.tostring(msg, msg_sz) == DEADLINE_PAYLOAD then
+                timeout_session_map[error_session_id] = true
+            end
         end
     end
 end
@@ -581,12 +588,42 @@ end
 --- send message to destination service (pack message)
 ---@param addr string|number service name or service handle
 ---@param svc_msg_type string service message type, e.g. "lua", "debug", ...
----@return
+---@return number|boolean, string session (0), or false if failed; "throttle" if the destination mailbox is full (throttle policy), "mailbox full" if rejected
 function skynet.send(addr, svc_msg_type, ...)
     local svc_msg_handler = svc_msg_handlers[svc_msg_type]
     return skynet_core.send(addr, svc_msg_handler.msg_type, 0, svc_msg_handler.pack(...))
 end
 
+---
+--- send messages in batch, the messages are grouped per destination service in core
+---@param batch table array of { addr, svc_msg_type, ... }, e.g. { { addr1, "lua", "cmd", ... }, { addr2, "lua", "cmd", ... } }
+---@return number the number of messages sent
+function skynet.send_batch(batch)
+    -- resolve the protocols first, an unknown protocol raises before any message is packed
+    local handlers = {}
+    for i, m in ipairs(batch) do
+        handlers[i] = svc_msg_handlers[m[2]] or error(string.format("Invalid batch message #%d: unknown protocol %s", i, tostring(m[2])))
+    end
+
+    local msgs = {}
+    local ok, ret = pcall(function()
+        for i, m in ipairs(batch) do
+            local svc_msg_handler = handlers[i]
+            msgs[i] = { m[1], svc_msg_handler.msg_type, 0, svc_msg_handler.pack(table.unpack(m, 3)) }
+        end
+        return skynet_core.send_batch(msgs)
+    end)
+    if not ok then
+        -- the core takes nothing from an invalid batch, release the packed messages
+        for _, msg in ipairs(msgs) do
+            skynet_core.trash(msg[4], msg[5])
+        end
+        error(ret, 0)
+    end
+
+    return ret
+end
+
 ---
 --- send raw message to destination service (not pack message)
 --- not pack message, include message and message length
@@ -617,7 +654,7 @@ local function yield_call(svc_handle, session_id)
     local succ, msg, msg_sz = thread_yield("SUSPEND")
     watching_session_map[session_id] = nil
     if not succ then
-        error "call failed"
+        error(msg and "call timeout" or "call failed")
     end
     return msg, msg_sz
 end
@@ -636,15 +673,57 @@ function skynet.call(addr, svc_msg_type, ...)
 
     -- call
     local svc_msg_handler = svc_msg_handlers[svc_msg_type]
-    local session_id = skynet_core.send(addr, svc_msg_handler.msg_type, nil, svc_msg_handler.pack(...))
+    local session_id, err = skynet_core.send(addr, svc_msg_handler.msg_type, nil, svc_msg_handler.pack(...))
     if session_id == nil then
         error("call to invalid address " .. skynet.to_address(addr))
     end
+    if session_id == false then
+        error(string.format("call to %s failed: %s", skynet.to_address(addr), err or "message too large"))
+    end
 
     -- suspend thread
     return svc_msg_handler.unpack(yield_call(addr, session_id))
 end
 
+---
+--- send message to destination service with a deadline (will suspend thread until the service response or the deadline)
+--- raise error "call timeout" when the deadline is reached (other errors raise "call failed"), the late response is dropped
+---@param ticks number deadline (1 tick = 10ms)
+---@param addr string|number service name or service handle
+---@param svc_msg_type string service message type, e.g. "lua", "debug", ...
+function skynet.timed_call(ticks, addr, svc_msg_type, ...)
+    -- trace call
+    local trace_tag = thread_trace_tag_map[current_thread]
+    if trace_tag then
+        skynet_core.trace(trace_tag, "call", 2)
+        skynet_core.send(addr, skynet.SERVICE_MSG_TYPE_TRACE, 0, trace_tag)
+    end
+
+    -- call (the deadline only applies to this call)
+    local svc_msg_handler = svc_msg_handlers[svc_msg_type]
+    local msg, msg_sz = svc_msg_handler.pack(...)
+    local prev = skynet_core.call_timeout(ticks)
+    local session_id, err = skynet_core.send(addr, svc_msg_handler.msg_type, nil, msg, msg_sz)
+    skynet_core.call_timeout(prev)
+    if session_id == nil then
+        error("call to invalid address " .. skynet.to_address(addr))
+    end
+    if session_id == false then
+        error(string.format("call to %s failed: %s", skynet.to_address(addr), err or "message too large"))
+    end
+
+    -- suspend thread
+    return svc_msg_handler.unpack(yield_call(addr, session_id))
+end
+
+---
+--- set the default deadline of the calls sent by current service (skynet.call, skynet.call_raw, ...)
+---@param ticks number deadline (1 tick = 10ms), 0: no deadline
+---@return number the previous deadline
+function skynet.call_timeout(ticks)
+    return skynet_core.call_timeout(ticks)
+end
+
 ---
 --- send message to destination service (will suspend thread until the service response)
 ---@param addr string|number service name or service handle
@@ -1125,6 +1204,84 @@ function skynet.stat(what)
     return skynet_core.intcommand("STAT", what)
 end
 
+---
+--- set the mailbox capacity of current service
+---@param capacity number max pending messages, 0: unlimited
+---@param policy string "reject" (default): the sender gets an error; "drop": drop the oldest messages; "throttle": accept and signal the sender
+function skynet.mailbox(capacity, policy)
+    skynet_core.command("MAILBOX", string.format("%d %s", capacity, policy or "reject"))
+end
+
+---
+--- set the cpu quota of current service, over quota the service runs after the other services until the window resets
+--- (window: config cpu_quota_window, default 1000ms). the default quota is set by config cpu_quota = "name:percent,..."
+---@param percent number cpu share of one worker thread per window, 0: unlimited
+function skynet.cpu_quota(percent)
+    skynet_core.command("QUOTA", tostring(percent))
+end
+
+---
+--- query the mailbox pressure of a service before sending
+---@param addr number service handle
+---@return number, number pending messages and capacity (0: unlimited), nil if the service not exists
+function skynet.pressure(addr)
+    return skynet_core.pressure(addr)
+end
+
+---
+--- query the outstanding calls to a service (sent by any service, not responded or expired), an overload signal
+---@param addr number service handle
+---@return number outstanding calls, nil if the service not exists
+function skynet.call_inbound(addr)
+    return skynet_core.call_inbound(addr)
+end
+
+---
+--- snapshot the runtime stat of all services in one call, read from the counters in core (no message to the services)
+---@return table key: service handle, value: { message = n, cpu = seconds (0 if profile is off), mqlen = n, overload = n, mem = kb (0: no lua vm) }
+function skynet.stat_all()
+    return skynet_core.stat_all()
+end
+
+---
+--- select a member of a service pool (see skynet.pool_register), sending to the pool name routes to the least loaded member,
+--- use a key to send an ordered stream to the same member
+---@param name string pool name, ".name"
+---@param key number|string sticky key (optional)
+---@return number service handle, nil if the pool not exists
+function skynet.pool_select(name, key)
+    return skynet_core.pool_select(name, key)
+end
+
+---
+--- set the sojourn time (queue waiting time) overload policy of current service
+--- when the sojourn time stays above target for an interval, droppable messages are shed or deferred to the queue tail
+---@param target_ms number sojourn time target (milliseconds)
+---@param interval_ms number the sojourn time must stay above target for a whole interval (milliseconds)
+---@param mode string "off": only track the sojourn time; "shed": drop the message; "defer": push the message back to the queue tail once
+---@param types table droppable message types, default { skynet.SERVICE_MSG_TYPE_CLIENT }
+function skynet.sojourn_policy(target_ms, interval_ms, mode, types)
+    local param = string.format("%g %g %s", target_ms, interval_ms, mode or "shed")
+    if types then
+        param = param .. " " .. table.concat(types, " ")
+    end
+    skynet_core.command("CODEL", param)
+end
+
+---
+--- query the sojourn time (queue waiting time) of current service
+---@return table p50, p90, p99, max (milliseconds), shed, defer
+function skynet.sojourn()
+    return {
+        p50 = skynet.stat "sojourn_p50",
+        p90 = skynet.stat "sojourn_p90",
+        p99 = skynet.stat "sojourn_p99",
+        max = skynet.stat "sojourn_max",
+        shed = skynet.stat "shed",
+        defer = skynet.stat "defer",
+    }
+end
+
 ---
 --- show service task detail
 ---@param ret
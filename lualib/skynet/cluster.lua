@@ -97,6 +97,24 @@ function cluster.register(name, addr)
     return skynet.call(clusterd, "lua", "register", name, addr)
 end
 
+--- register a global name, replicated to all cluster nodes (cluster.open(node_name) first).
+--- a service on any node can send to it by the name directly, e.g. skynet.send("name", "lua", ...), resolved locally.
+--- the name is unregistered when the service exits.
+function cluster.register_global(name, addr)
+    assert(type(name) == "string" and not name:find("^[.:@]"))
+    assert(addr == nil or type(addr) == "number")
+    return skynet.call(clusterd, "lua", "register_global", name, addr)
+end
+
+function cluster.unregister_global(name)
+    return skynet.call(clusterd, "lua", "unregister_global", name)
+end
+
+--- the local address of a global name (the service, or the proxy of a remote service), nil if not exists
+function cluster.query_global(name)
+    return skynet.localname(name)
+end
+
 function cluster.query(node, name)
     return skynet.call(get_sender(node), "lua", "req", 0, skynet.pack(name))
 end
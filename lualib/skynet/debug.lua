@@ -27,8 +27,23 @@ local function init(skynet, export)
             local stat = {}
             stat.task = skynet.task()
             stat.mqlen = skynet.stat "mqlen"
+            stat.mqslots = skynet.stat "mqslots"
+            stat.mqpeak = skynet.stat "mqpeak"
+            stat.mqmem = skynet.stat "mqmem"
             stat.cpu = skynet.stat "cpu"
             stat.message = skynet.stat "message"
+            stat.lane_high = skynet.stat "lane_high"
+            stat.lane_normal = skynet.stat "lane_normal"
+            stat.reject = skynet.stat "reject"
+            stat.drop = skynet.stat "drop"
+            stat.sojourn_p50 = skynet.stat "sojourn_p50"
+            stat.sojourn_p99 = skynet.stat "sojourn_p99"
+            stat.shed = skynet.stat "shed"
+            stat.defer = skynet.stat "defer"
+            stat.call_pending = skynet.stat "call_pending"
+            stat.call_inbound = skynet.stat "call_inbound"
+            stat.call_timeout = skynet.stat "call_timeout"
+            stat.quota_throttle = skynet.stat "quota_throttle"
             skynet.ret(skynet.pack(stat))
         end
 
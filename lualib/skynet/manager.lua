@@ -33,6 +33,21 @@ function skynet.register(name)
     skynet_core.command("REGISTER", name)
 end
 
+---
+--- join a service pool, the instances share one name, messages sent to the name go to the least loaded instance
+---@param name string pool name, ".name"
+---@param route string "length" (default): shortest queue; "sojourn": lowest recent sojourn time
+function skynet.pool_register(name, route)
+    skynet_core.command("POOL", string.format("join %s %s", name, route or "length"))
+end
+
+---
+--- leave a service pool
+---@param name string pool name, ".name"
+function skynet.pool_unregister(name)
+    skynet_core.command("POOL", "leave " .. name)
+end
+
 ---
 ---@param name string
 ---@param handle
@@ -40,6 +55,17 @@ function skynet.name(name, handle)
     skynet_core.command("NAME", name .. " " .. skynet.to_address(handle))
 end
 
+---
+--- apply a global name update to the node's global name directory (used by clusterd)
+--- any service can send to a global name directly after it's set, e.g. skynet.send("name", "lua", ...)
+---@param name string global name (without '.' or ':')
+---@param handle number local address: the service, or the proxy of a remote service. 0: removed
+---@param version number update version, the update is ignored if not newer than the current one
+---@return boolean applied
+function skynet.global_name(name, handle, version)
+    return skynet_core.command("GNAME", string.format("%s %s %d", name, skynet.to_address(handle), version)) ~= nil
+end
+
 local handle_service_message = skynet.handle_service_message
 
 ---
@@ -54,7 +80,7 @@ function skynet.forward_by_type(forward_svc_msg_type_map, start_func)
             handle_service_message(fowward_msg_type, msg, msg_sz, ...)
         else
             local ok, err = pcall(handle_service_message, svc_msg_type, msg, msg_sz, ...)
-            skynet_core.trash(msg, msg_sz)
+            skynet_core.trash(msg, msg_sz, svc_msg_type)
             if not ok then
                 error(err)
             end
@@ -0,0 +1,87 @@
+local skynet = require "skynet"
+local mc = require "skynet.multicast.core"
+
+local assert = assert
+
+---
+--- native multicast channel
+---
+--- publish once, all subscribers receive the same reference-counted payload,
+--- the payload is packed only once no matter how many subscribers.
+local multicast = {}
+
+-- channel id -> message handler
+local channel_handlers = {}
+
+local function dispatch_multicast(session_id, src_svc_handle, channel, ...)
+    local f = channel_handlers[channel]
+    if f then
+        f(channel, src_svc_handle, ...)
+    end
+end
+
+---
+--- create a channel
+---@return number channel id
+function multicast.new()
+    return mc.new()
+end
+
+---
+--- delete a channel, the subscribers will not receive any more messages
+---@param channel number channel id
+function multicast.delete(channel)
+    channel_handlers[channel] = nil
+    return mc.delete(channel)
+end
+
+---
+--- subscribe a channel
+---@param channel number channel id
+---@param f function message handler, f(channel, source, ...)
+function multicast.subscribe(channel, f)
+    assert(type(f) == "function")
+    if not mc.subscribe(channel) then
+        return false
+    end
+    channel_handlers[channel] = f
+    return true
+end
+
+---
+--- unsubscribe a channel
+---@param channel number channel id
+function multicast.unsubscribe(channel)
+    channel_handlers[channel] = nil
+    return mc.unsubscribe(channel)
+end
+
+---
+--- publish a message to all subscribers of the channel
+---@param channel number channel id
+---@return number the number of subscribers, -1 if the channel not exists
+function multicast.publish(channel, ...)
+    return mc.publish(channel, skynet.pack(...))
+end
+
+---
+--- the number of published packages not released by all subscribers yet (whole node)
+---@return number
+function multicast.packages()
+    return mc.packages()
+end
+
+-- register multicast message handler
+do
+    skynet.register_svc_msg_handler({
+        msg_type_name = "multicast",
+        msg_type = skynet.SERVICE_MSG_TYPE_MULTICAST,
+        unpack = function(msg, msg_sz)
+            local channel, data, data_sz = mc.unpack(msg, msg_sz)
+            return channel, skynet.unpack(data, data_sz)
+        end,
+        dispatch = dispatch_multicast,
+    })
+end
+
+return multicast
@@ -11,6 +11,13 @@ local connecting = {}           -- cluster node connecting info = { node_name =
 
 --- the name of this cluster node (format: hostname+pid)
 local this_node_name = cluster_core.nodename()
+--- the cluster node name of this node (set by cluster.open(node_name))
+local self_node = nil
+
+--- global name directory (replicated to every cluster node), key: global name, value: { node = owner node, addr = address in owner node (nil: removed), version = version }
+local global_names = {}
+--- lamport clock of global name versions, version = clock << 16 | node tag (tie-break of concurrent updates)
+local global_clock = 0
 
 ---
 --- open sender service
@@ -169,14 +176,22 @@ function CMD.reload(source, config)
     skynet.ret_pack(nil)
 end
 
+local sync_global
+
 function CMD.listen(source, addr, port)
     local gate = skynet.newservice("gate")
     if port == nil then
         local node_address = assert(node_map[addr], addr .. " is down")
+        self_node = addr
         addr, port = string.match(node_address, "([^:]+):(.*)$")
     end
     skynet.call(gate, "lua", "open", { address = addr, port = port })
     skynet.ret_pack(nil)
+
+    -- pull the global name directory from the other nodes
+    if self_node then
+        skynet.fork(sync_global)
+    end
 end
 
 function CMD.sender(source, node)
@@ -189,13 +204,7 @@ end
 
 local proxy = {}
 
-function CMD.proxy(source, node, name)
-    if name == nil then
-        node, name = node:match "^([^@.]+)([@.].+)"
-        if name == nil then
-            error("Invalid name " .. tostring(node))
-        end
-    end
+local function get_proxy(node, name)
     local fullname = node .. "." .. name
     local p = proxy[fullname]
     if p == nil then
@@ -208,7 +217,145 @@ function CMD.proxy(source, node, name)
             proxy[fullname] = p
         end
     end
-    skynet.ret_pack(p)
+    return p
+end
+
+function CMD.proxy(source, node, name)
+    if name == nil then
+        node, name = node:match "^([^@.]+)([@.].+)"
+        if name == nil then
+            error("Invalid name " .. tostring(node))
+        end
+    end
+    skynet.ret_pack(get_proxy(node, name))
+end
+
+---
+--- global name directory
+---
+--- a global name is registered on its owner node (cluster.register_global), the update is versioned and pushed to all cluster nodes.
+--- every node keeps a replica, and maps the name to a local address (the service, or a proxy of the remote service) in the node's
+--- global name directory, services resolve the name locally (skynet.send("name", ...)), no network hop after the proxy is created.
+--- a node pulls the whole directory from the other nodes when it opens (cluster.open(node_name)).
+
+local function node_tag(node)
+    local h = 0
+    for i = 1, #node do
+        h = (h * 31 + node:byte(i)) % 65536
+    end
+    return h
+end
+
+-- apply an update (local or replicated), return true if it's newer
+local function apply_global(name, node, addr, version)
+    local entry = global_names[name]
+    if entry and version <= entry.version then
+        return false
+    end
+    global_clock = math.max(global_clock, version >> 16)
+    entry = { node = node, addr = addr, version = version }
+    global_names[name] = entry
+
+    -- local address
+    local handle = 0
+    if addr then
+        handle = node == self_node and addr or get_proxy(node, addr)
+    end
+    -- a newer update may be applied while creating the proxy, the node directory ignores the stale one
+    if global_names[name] == entry then
+        skynet.global_name(name, handle, version)
+    end
+    return true
+end
+
+-- push an update to the other nodes
+local function push_global(name, entry)
+    for node, node_address in pairs(node_map) do
+        if node ~= self_node and node_address then
+            skynet.fork(function()
+                local ok, sender = pcall(function() return node_channel[node] end)
+                if ok and sender then
+                    skynet.send(sender, "lua", "push", "@clusterd", skynet.pack("global_update", name, entry.node, entry.addr, entry.version))
+                else
+                    skynet.log_info(string.format("push global name [%s] to node [%s] failed: %s", name, node, tostring(sender)))
+                end
+            end)
+        end
+    end
+end
+
+-- pull the directory from the other nodes
+function sync_global()
+    for node, node_address in pairs(node_map) do
+        if node ~= self_node and node_address then
+            skynet.fork(function()
+                local ok, entries = pcall(function()
+                    return skynet.call(node_channel[node], "lua", "req", "@clusterd", skynet.pack("global_snapshot"))
+                end)
+                if ok then
+                    for name, entry in pairs(entries) do
+                        apply_global(name, entry.node, entry.addr, entry.version)
+                    end
+                else
+                    skynet.log_info(string.format("sync global names from node [%s] failed: %s", node, tostring(entries)))
+                end
+            end)
+        end
+    end
+end
+
+local function update_global(name, addr)
+    assert(self_node, "cluster.open(node_name) first")
+    global_clock = global_clock + 1
+    local version = global_clock << 16 | node_tag(self_node)
+    apply_global(name, self_node, addr, version)
+    push_global(name, global_names[name])
+end
+
+function CMD.register_global(source, name, addr)
+    update_global(name, addr or source)
+    skynet.ret(nil)
+    skynet.log_info(string.format("Register global [%s] :%08x", name, addr or source))
+end
+
+-- the service of a global name exited, the node directory removed the name and tells the registrar (see service_manager::unregister_service)
+local function global_exited(source, name)
+    local entry = global_names[name]
+    if entry == nil or entry.addr == nil then
+        return
+    end
+
+    if entry.node == self_node then
+        -- the owner exited, publish the removal
+        if entry.addr == source then
+            update_global(name, nil)
+            skynet.log_info(string.format("Unregister global [%s] :%08x, the service exited", name, source))
+        end
+    else
+        -- the proxy exited, the next update creates a new one
+        local fullname = entry.node .. "." .. entry.addr
+        if proxy[fullname] == source then
+            proxy[fullname] = nil
+        end
+    end
+end
+
+function CMD.unregister_global(source, name)
+    local entry = global_names[name]
+    if entry and entry.addr then
+        update_global(name, nil)
+    end
+    skynet.ret(nil)
+end
+
+-- replicated update from other nodes
+function CMD.global_update(source, name, node, addr, version)
+    apply_global(name, node, addr, version)
+end
+
+-- the whole directory (include removed names)
+function CMD.global_snapshot(source)
+    skynet.ret_pack(global_names)
 end
 
 local cluster_agent = {}    -- key: fd, value: service
@@ -273,6 +420,20 @@ skynet.start(function()
     --
     load_config()
 
+    -- other nodes reach the global name directory by "@clusterd"
+    register_name["clusterd"] = skynet.self()
+    register_name[skynet.self()] = "clusterd"
+
+    -- the exited services of the global names
+    skynet.register_svc_msg_handler({
+        msg_type_name = "text",
+        msg_type = skynet.SERVICE_MSG_TYPE_TEXT,
+        unpack = skynet.tostring,
+        dispatch = function(_, src_svc_handle, name)
+            global_exited(src_svc_handle, name)
+        end,
+    })
+
     -- set service message dispatch function
     skynet.dispatch("lua", function(session_id, src_svc_handle, cmd, ...)
         local f = assert(CMD[cmd])
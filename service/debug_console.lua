@@ -143,6 +143,7 @@ function CMD.help()
         help = "This help message",
         list = "List all the service",
         stat = "Dump all stats",
+        faststat = "Dump the core counters of all services, without calling them",
         info = "info address : get service infomation",
         exit = "exit address : kill a lua service",
         kill = "kill address : kill service",
@@ -167,6 +168,7 @@ function CMD.help()
         netstat = "netstat : show netstat",
         profactive = "profactive [on|off] : active/deactive jemalloc heap profilling",
         dumpheap = "dumpheap : dump heap profilling",
+        thread = "thread [count|auto] : show/set the number of active worker threads",
     }
 end
 
@@ -232,6 +234,10 @@ function CMD.stat()
     return skynet.call(".launcher", "lua", "STAT")
 end
 
+function CMD.faststat()
+    return skynet.call(".launcher", "lua", "FASTSTAT")
+end
+
 function CMD.mem()
     return skynet.call(".launcher", "lua", "MEM")
 end
@@ -433,6 +439,17 @@ function CMD.netstat()
     return stat
 end
 
+function CMD.thread(count)
+    local ret = skynet_core.command("THREAD", count or "")
+    local active, min, max, mode = string.match(ret or "", "(%d+) (%d+) (%d+) (%a+)")
+    return {
+        active = tonumber(active),
+        min = tonumber(min),
+        max = tonumber(max),
+        mode = mode,
+    }
+end
+
 function CMD.dumpheap()
     memory.dumpheap()
 end
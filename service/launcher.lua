@@ -39,6 +39,20 @@ function CMD.STAT()
     return list
 end
 
+-- the core counters read in one snapshot (skynet.stat_all), no call to each service
+function CMD.FASTSTAT()
+    local all = skynet.stat_all()
+    local list = {}
+    for k, v in pairs(services) do
+        local stat = all[k]
+        if stat == nil then
+            stat = string.format("ERROR (%s)", v)
+        end
+        list[skynet.to_address(k)] = stat
+    end
+    return list
+end
+
 function CMD.KILL(_, handle)
     handle = handle_to_address(handle)
     skynet.kill(handle)
@@ -47,14 +61,16 @@ function CMD.KILL(_, handle)
     return ret
 end
 
+-- lua memory is published by each service after every message
 function CMD.MEM()
+    local all = skynet.stat_all()
     local list = {}
     for k, v in pairs(services) do
-        local ok, kb = pcall(skynet.call, k, "debug", "MEM")
-        if not ok then
+        local stat = all[k]
+        if stat == nil then
             list[skynet.to_address(k)] = string.format("ERROR (%s)", v)
         else
-            list[skynet.to_address(k)] = string.format("%.2f Kb (%s)", kb, v)
+            list[skynet.to_address(k)] = string.format("%.2f Kb (%s)", stat.mem, v)
         end
     end
     return list
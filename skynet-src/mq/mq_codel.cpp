@@ -0,0 +1,169 @@
+#include "mq_codel.h"
+#include "mq_msg.h"
+
+#include <cmath>
+
+namespace skynet {
+
+void mq_codel::set_policy(int mode, uint64_t target_ns, uint64_t interval_ns, uint32_t droppable_types)
+{
+    mode_ = mode;
+    target_ns_ = target_ns;
+    interval_ns_ = interval_ns;
+    droppable_types_ = droppable_types;
+
+    // reset state
+    first_above_ns_ = 0;
+    is_dropping_ = false;
+    drop_count_ = 0;
+}
+
+void mq_codel::reset()
+{
+    set_policy(MODE_OFF, DEFAULT_TARGET_NS, DEFAULT_INTERVAL_NS, 0);
+    drop_next_ns_ = 0;
+
+    for (auto& n : histogram_)
+        n = 0;
+    sample_count_ = 0;
+    max_ns_ = 0;
+    shed_count_ = 0;
+    defer_count_ = 0;
+    recent_ns_.store(0, std::memory_order_relaxed);
+}
+
+int mq_codel::on_dequeue(service_message* message, uint64_t now_ns)
+{
+    uint64_t sojourn_ns = now_ns > message->enqueue_ns ? now_ns - message->enqueue_ns : 0;
+    _record(sojourn_ns);
+
+    if (mode_ == MODE_OFF)
+        return ACTION_DISPATCH;
+
+    return _control(message, sojourn_ns, now_ns);
+}
+
+uint64_t mq_codel::percentile(int percent)
+{
+    if (sample_count_ == 0)
+        return 0;
+
+    uint64_t threshold = ((uint64_t)sample_count_ * percent + 99) / 100;
+    uint64_t count = 0;
+    for (int i = 0; i < HISTOGRAM_SIZE; i++)
+    {
+        count += histogram_[i];
+        if (count >= threshold && count > 0)
+        {
+            // bucket i: [2^(i-1), 2^i) microseconds
+            uint64_t upper_ns = (1ull << i) * 1000;
+            return upper_ns < max_ns_ ? upper_ns : max_ns_;
+        }
+    }
+
+    return max_ns_;
+}
+
+uint64_t mq_codel::max_sojourn()
+{
+    return max_ns_;
+}
+
+uint64_t mq_codel::recent_sojourn()
+{
+    return recent_ns_.load(std::memory_order_relaxed);
+}
+
+uint64_t mq_codel::shed_count()
+{
+    return shed_count_;
+}
+
+uint64_t mq_codel::defer_count()
+{
+    return defer_count_;
+}
+
+void mq_codel::_record(uint64_t sojourn_ns)
+{
+    uint64_t us = sojourn_ns / 1000;
+    int idx = 0;
+    while (us != 0 && idx < HISTOGRAM_SIZE - 1)
+    {
+        us >>= 1;
+        ++idx;
+    }
+    ++histogram_[idx];
+
+    if (sojourn_ns > max_ns_)
+        max_ns_ = sojourn_ns;
+
+    // moving average, weight 1/8
+    uint64_t recent_ns = recent_ns_.load(std::memory_order_relaxed);
+    recent_ns_.store(recent_ns - recent_ns / 8 + sojourn_ns / 8, std::memory_order_relaxed);
+
+    // decay, keep recent samples weighted
+    if (++sample_count_ >= DECAY_SAMPLES)
+    {
+        sample_count_ = 0;
+        for (auto& n : histogram_)
+        {
+            n /= 2;
+            sample_count_ += n;
+        }
+        max_ns_ /= 2;
+    }
+}
+
+int mq_codel::_control(service_message* message, uint64_t sojourn_ns, uint64_t now_ns)
+{
+    // only droppable messages drive the control law.
+    // response/system/error skip the line (high lane), their sojourn time doesn't tell the backlog, and they are never dropped.
+    int svc_msg_type = message->data_size >> MESSAGE_TYPE_SHIFT;
+    if ((droppable_types_ & (1u << svc_msg_type)) == 0)
+        return ACTION_DISPATCH;
+
+    // good queue
+    if (sojourn_ns < target_ns_)
+    {
+        first_above_ns_ = 0;
+        is_dropping_ = false;
+        return ACTION_DISPATCH;
+    }
+
+    // above target, wait a whole interval before dropping
+    if (first_above_ns_ == 0)
+    {
+        first_above_ns_ = now_ns + interval_ns_;
+        return ACTION_DISPATCH;
+    }
+    if (now_ns < first_above_ns_)
+        return ACTION_DISPATCH;
+
+    // enter dropping state
+    if (!is_dropping_)
+    {
+        is_dropping_ = true;
+        drop_count_ = 0;
+        drop_next_ns_ = now_ns;
+    }
+
+    if (now_ns < drop_next_ns_)
+        return ACTION_DISPATCH;
+
+    // control law, drop faster while the queue stays bad
+    ++drop_count_;
+    drop_next_ns_ = now_ns + (uint64_t)(interval_ns_ / std::sqrt((double)drop_count_));
+
+    // a message is deferred at most once
+    if (mode_ == MODE_DEFER && !message->is_deferred)
+    {
+        ++defer_count_;
+        return ACTION_DEFER;
+    }
+
+    ++shed_count_;
+    return ACTION_SHED;
+}
+
+}
@@ -0,0 +1,98 @@
+/**
+ * queue sojourn time tracking & CoDel overload control (one per service private queue, consumer only)
+ *
+ * 1) every message is timestamped at enqueue, the consumer measures how long it waited (sojourn time) at dequeue.
+ * 2) sojourn times are recorded in a log2 histogram (microseconds), old samples decay by half every DECAY_SAMPLES.
+ * 3) CoDel: when the sojourn time stays above target for a whole interval, the queue enters dropping state,
+ *    droppable messages are shed (or deferred to the queue tail once) at the control law pace: interval / sqrt(count).
+ *    the queue leaves dropping state once a message waits less than target.
+ * 4) recent sojourn time (moving average) can be read by any thread, used by service pool routing.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+
+namespace skynet {
+
+// forward declare
+struct service_message;
+
+class mq_codel final
+{
+public:
+    // overload policy modes
+    enum policy_mode
+    {
+        MODE_OFF = 0,                                       // only track sojourn time
+        MODE_SHED = 1,                                      // drop droppable messages
+        MODE_DEFER = 2,                                     // push droppable messages back to the queue tail (once)
+    };
+
+    // dequeue actions
+    enum action
+    {
+        ACTION_DISPATCH = 0,                                //
+        ACTION_SHED = 1,                                    // drop the message
+        ACTION_DEFER = 2,                                   // push the message back to the queue tail
+    };
+
+private:
+    // constants
+    enum
+    {
+        HISTOGRAM_SIZE = 32,                                // log2 buckets of microseconds
+        DECAY_SAMPLES = 4096,                               // halve the histogram every n samples
+        DEFAULT_TARGET_NS = 5000000,                        // default sojourn target, 5ms
+        DEFAULT_INTERVAL_NS = 100000000,                    // default interval, 100ms
+    };
+
+private:
+    // policy
+    int mode_ = MODE_OFF;                                   //
+    uint64_t target_ns_ = DEFAULT_TARGET_NS;                // sojourn target
+    uint64_t interval_ns_ = DEFAULT_INTERVAL_NS;            // interval
+    uint32_t droppable_types_ = 0;                          // bit mask of droppable message types
+
+    // CoDel state
+    uint64_t first_above_ns_ = 0;                           // time when sojourn has been above target for a whole interval
+    uint64_t drop_next_ns_ = 0;                             // next drop time in dropping state
+    uint32_t drop_count_ = 0;                               // drops since entering dropping state
+    bool is_dropping_ = false;                              // in dropping state
+
+    // stat
+    uint32_t histogram_[HISTOGRAM_SIZE] = { 0 };            // sojourn time histogram
+    uint32_t sample_count_ = 0;                             // samples in histogram
+    uint64_t max_ns_ = 0;                                   // max sojourn time
+    uint64_t shed_count_ = 0;                               // number of messages shed
+    uint64_t defer_count_ = 0;                              // number of messages deferred
+    std::atomic<uint64_t> recent_ns_ { 0 };                 // moving average of sojourn time (written by consumer, read by any thread)
+
+public:
+    // set overload policy, droppable_types: bit mask of message types (1 << type)
+    void set_policy(int mode, uint64_t target_ns, uint64_t interval_ns, uint32_t droppable_types);
+    // reset policy, state and stat to the defaults (queue reuse)
+    void reset();
+
+    // record the sojourn time of a dequeued message, return the action to the message
+    int on_dequeue(service_message* message, uint64_t now_ns);
+
+    // sojourn time percentile (nanoseconds, upper bound of the histogram bucket), percent: 0 ~ 100
+    uint64_t percentile(int percent);
+    // max sojourn time (nanoseconds)
+    uint64_t max_sojourn();
+    // recent sojourn time (nanoseconds, moving average), any thread
+    uint64_t recent_sojourn();
+
+    uint64_t shed_count();
+    uint64_t defer_count();
+
+private:
+    // record a sample to histogram
+    void _record(uint64_t sojourn_ns);
+    // CoDel control law
+    int _control(service_message* message, uint64_t sojourn_ns, uint64_t now_ns);
+};
+
+}
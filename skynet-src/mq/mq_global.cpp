@@ -1,18 +1,28 @@
 /**
  * 队列处理流程
  * 1) 调用 mq_private->push 向消息队列压入一个消息
- * 2) 然后，调用 mq_global::push 把消息队列链到 global_queue 尾部
- * 3) 从全局链表弹出一个消息队列，处理队列中的消息，如果队列的消息处理完则不压回全局链表，如果未处理完则重新压入全局链表，等待下一次处理
+ * 2) 然后，调用 mq_global::push 把消息队列压入当前工作线程的本地运行队列 (非工作线程则链到 global_queue 尾部)
+ * 3) 从本地运行队列 (或全局链表, 或其他工作线程) 弹出一个消息队列，处理队列中的消息，如果队列的消息处理完则不压回，如果未处理完则重新压入，等待下一次处理
  * 具体的细节还是要查看 dispatch_message 这个函数
  */
 
 #include "mq_global.h"
 #include "mq_private.h"
+#include "mq_runq.h"
 
 #include <cassert>
 
 namespace skynet {
 
+// worker index of current thread (-1: not a worker thread)
+static thread_local int tls_worker_idx = -1;
+// pop counter of current worker thread
+static thread_local uint32_t tls_sched_tick = 0;
+// queue handed off to current worker thread (call fast path)
+static thread_local mq_private* tls_handoff = nullptr;
+// handoffs in a row
+static thread_local int tls_handoff_chain = 0;
+
 mq_global* mq_global::instance_ = nullptr;
 
 mq_global* mq_global::instance()
@@ -24,48 +34,276 @@ mq_global* mq_global::instance()
 }
 
 // 全局队列初始化
-void mq_global::init()
+void mq_global::init(int worker_num, bool is_handoff/* = false*/)
+{
+    assert(worker_num > 0);
+
+    worker_num_ = worker_num;
+    is_handoff_ = is_handoff;
+    runqs_ = new mq_runq[worker_num];
+}
+
+void mq_global::bind_worker(int worker_idx)
+{
+    assert(worker_idx >= 0 && worker_idx < worker_num_);
+
+    tls_worker_idx = worker_idx;
+    tls_sched_tick = 0;
+    tls_handoff = nullptr;
+    tls_handoff_chain = 0;
+}
+
+void mq_global::set_notify(mq_notify_proc notify_func, void* ud)
 {
+    notify_ud_ = ud;
+    notify_func_.store(notify_func);
 }
 
-void mq_global::push(mq_private* q)
+void mq_global::push(mq_private* q, bool is_high/* = false*/)
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    _push(q, is_high);
 
+    // wakeup an idle worker
+    mq_notify_proc notify_func = notify_func_.load(std::memory_order_acquire);
+    if (notify_func != nullptr)
+    {
+        notify_func(notify_ud_);
+    }
+}
+
+void mq_global::_push(mq_private* q, bool is_high)
+{
     assert(q->next_ == nullptr);
 
-    // like list not empty
-    if(tail_ != nullptr)
+    // over cpu quota, behind all the others (even if high priority messages pending)
+    if (q->is_low_.load(std::memory_order_relaxed))
+    {
+        _push_global(low_list_, q, q, 1);
+        return;
+    }
+
+    int worker_idx = tls_worker_idx;
+    if (worker_idx < 0)
+    {
+        _push_global(is_high ? high_list_ : normal_list_, q, q, 1);
+        return;
+    }
+
+    // local run queue
+    mq_runq& runq = runqs_[worker_idx];
+    if (is_high)
+    {
+        // the old runnext queue goes to the ring
+        q = runq.push_next(q);
+        if (q == nullptr)
+            return;
+    }
+    if (runq.push(q))
+        return;
+
+    // local run queue is full, move half of it and q to global mq
+    mq_private* head = nullptr;
+    mq_private* tail = nullptr;
+    int n = runq.pop_half(head, tail);
+    if (n == 0)
     {
-        tail_->next_ = q;
-        tail_ = q;
+        head = tail = q;
     }
     else
     {
-        head_ = tail_ = q;
+        tail->next_ = q;
+        tail = q;
     }
+    _push_global(normal_list_, head, tail, n + 1);
+}
+
+bool mq_global::handoff(mq_private* q)
+{
+    assert(q->next_ == nullptr);
+
+    if (!is_handoff_ || tls_worker_idx < 0 || tls_handoff != nullptr || tls_handoff_chain >= HANDOFF_CHAIN_MAX)
+        return false;
+
+    // over cpu quota, no fast path
+    if (q->is_low_.load(std::memory_order_relaxed))
+        return false;
+
+    tls_handoff = q;
+    return true;
+}
+
+bool mq_global::is_handoff_pending()
+{
+    return tls_handoff != nullptr;
 }
 
 mq_private* mq_global::pop()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    // handed off queue (call fast path)
+    mq_private* q = tls_handoff;
+    if (q != nullptr)
+    {
+        tls_handoff = nullptr;
+        ++tls_handoff_chain;
+        return q;
+    }
+    tls_handoff_chain = 0;
+
+    // high priority first
+    q = _pop_global(high_list_);
+    if (q != nullptr)
+        return q;
+
+    int worker_idx = tls_worker_idx;
+    if (worker_idx < 0)
+    {
+        q = _pop_global(normal_list_);
+        return q != nullptr ? q : _pop_global(low_list_);
+    }
+
+    // check global mq once a while, make sure it can't be starved
+    if (++tls_sched_tick % GLOBAL_CHECK_INTERVAL == 0)
+    {
+        q = _pop_global(normal_list_);
+        if (q != nullptr)
+            return q;
+    }
+    // check low priority queue once a while, a small share for the queues over cpu quota
+    if (tls_sched_tick % LOW_CHECK_INTERVAL == 0)
+    {
+        q = _pop_global(low_list_);
+        if (q != nullptr)
+            return q;
+    }
+
+    // local run queue
+    q = runqs_[worker_idx].pop();
+    if (q != nullptr)
+        return q;
+
+    // global mq
+    q = _pop_global(normal_list_);
+    if (q != nullptr)
+        return q;
+
+    // steal from other workers
+    q = _steal(worker_idx);
+    if (q != nullptr)
+        return q;
+
+    // nothing else to run
+    return _pop_global(low_list_);
+}
+
+int mq_global::length()
+{
+    int length = high_list_.length.load(std::memory_order_relaxed) + normal_list_.length.load(std::memory_order_relaxed)
+        + low_list_.length.load(std::memory_order_relaxed);
+
+    int worker_idx = tls_worker_idx;
+    if (worker_idx >= 0)
+    {
+        length += runqs_[worker_idx].length();
+    }
+
+    return length;
+}
+
+int mq_global::runnable_count()
+{
+    int length = high_list_.length.load(std::memory_order_relaxed) + normal_list_.length.load(std::memory_order_relaxed)
+        + low_list_.length.load(std::memory_order_relaxed);
+    for (int i = 0; i < worker_num_; i++)
+    {
+        length += runqs_[i].length();
+    }
+
+    return length;
+}
+
+void mq_global::drain_worker()
+{
+    int worker_idx = tls_worker_idx;
+    if (worker_idx < 0)
+        return;
+
+    mq_private* q = tls_handoff;
+    tls_handoff = nullptr;
+    tls_handoff_chain = 0;
+    if (q != nullptr)
+    {
+        _push_global(q->is_high_pending() ? high_list_ : normal_list_, q, q, 1);
+    }
+
+    mq_runq& runq = runqs_[worker_idx];
+    while ((q = runq.pop()) != nullptr)
+    {
+        _push_global(q->is_high_pending() ? high_list_ : normal_list_, q, q, 1);
+    }
+}
+
+void mq_global::_push_global(mq_list& list, mq_private* head, mq_private* tail, int n)
+{
+    std::lock_guard<std::mutex> lock(list.mutex);
 
-    mq_private* mq = head_;
+    // like list not empty
+    if (list.tail != nullptr)
+    {
+        list.tail->next_ = head;
+        list.tail = tail;
+    }
+    else
+    {
+        list.head = head;
+        list.tail = tail;
+    }
+    list.length.fetch_add(n, std::memory_order_release);
+}
+
+mq_private* mq_global::_pop_global(mq_list& list)
+{
+    // empty, don't touch the lock
+    if (list.length.load(std::memory_order_acquire) == 0)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(list.mutex);
+
+    mq_private* mq = list.head;
     if (mq != nullptr)
     {
         // 注意这里，队列取出来后，就从链表中删除了
-        head_ = mq->next_;
-        if (head_ == nullptr)
+        list.head = mq->next_;
+        if (list.head == nullptr)
         {
-            assert(mq == tail_);
-            tail_ = nullptr;
+            assert(mq == list.tail);
+            list.tail = nullptr;
         }
         mq->next_ = nullptr;
+        list.length.fetch_sub(1, std::memory_order_relaxed);
     }
 
     return mq;
 }
 
+mq_private* mq_global::_steal(int worker_idx)
+{
+    mq_runq& runq = runqs_[worker_idx];
+
+    // start from different victim each time, spread the thieves
+    int start = static_cast<int>(tls_sched_tick % worker_num_);
+    for (int i = 0; i < worker_num_; i++)
+    {
+        int victim_idx = (start + i) % worker_num_;
+        if (victim_idx == worker_idx)
+            continue;
+
+        mq_private* q = runq.steal(&runqs_[victim_idx]);
+        if (q != nullptr)
+            return q;
+    }
+
+    return nullptr;
 }
 
+}
 
@@ -1,13 +1,34 @@
 #pragma once
 
+#include <atomic>
 #include <mutex>
 
 namespace skynet {
 
 // forward declare
 class mq_private;
+class mq_runq;
 
-// global message queue (link list)
+// runnable queue notify function (wakeup an idle worker)
+typedef void (*mq_notify_proc)(void* ud);
+
+/**
+ * global message queue
+ *
+ * 1) each worker thread has a local run queue (mq_runq), the worker push/pop runnable service queues there first.
+ * 2) the link list is the injection queue, used by non-worker threads (socket, timer, bootstrap) and local run queue overflow.
+ * 3) a worker with nothing to run steals half of another worker's local run queue.
+ * 4) priority: a queue which has high lane messages (response, system, error) pending is pushed to the runnext slot of
+ *    local run queue, or the high priority link list (non-worker threads), both are popped before normal queues.
+ *    only a newly woken queue takes runnext, a queue pushed back after its turn goes to the ring tail.
+ * 5) call fast path (optional): a queue made runnable by a call request or response sent from a worker thread is handed off
+ *    to the sending worker, it runs right after the current message, no other worker is woken up and it can't be stolen.
+ *    the handoff chain is bounded, so a ping-pong pair can't starve the other queues of the worker.
+ * 6) low priority: a queue over its cpu quota (mq_private::is_low_) goes to the low priority link list, popped when there
+ *    is nothing else to run, or once every LOW_CHECK_INTERVAL pops (so it still gets a small share of a busy node).
+ * 7) worker scaling: local run queues are created for the max worker count, a retiring worker drains its local run queue
+ *    to global mq, the others steal from all local run queues.
+ */
 class mq_global final
 {
 private:
@@ -16,19 +37,73 @@ public:
     static mq_global* instance();
 
 private:
-    // service mq link list
-    mq_private* head_ = nullptr;
-    mq_private* tail_ = nullptr;
-    std::mutex mutex_;
+    // constants
+    enum
+    {
+        GLOBAL_CHECK_INTERVAL = 61,                         // check injection queue every N pops, so it can't be starved by local run queues
+        HANDOFF_CHAIN_MAX = 16,                             // max handoffs in a row, then a normal pop
+        LOW_CHECK_INTERVAL = 127,                           // check low priority queue every N pops
+    };
+
+private:
+    // service mq link list (injection queue)
+    struct mq_list
+    {
+        mq_private* head = nullptr;
+        mq_private* tail = nullptr;
+        std::atomic<int> length { 0 };                      // injection queue length, check without lock
+        std::mutex mutex;
+    };
+
+    mq_list normal_list_;                                   // normal priority
+    mq_list high_list_;                                     // high priority
+    mq_list low_list_;                                      // low priority (over cpu quota)
+
+    // worker local run queues
+    int worker_num_ = 0;
+    mq_runq* runqs_ = nullptr;
+
+    // call fast path
+    bool is_handoff_ = false;
+
+    // notify after a queue become runnable
+    std::atomic<mq_notify_proc> notify_func_ { nullptr };
+    void* notify_ud_ = nullptr;
 
 public:
-    // initialize
-    void init();
+    // initialize, is_handoff: enable call fast path
+    void init(int worker_num, bool is_handoff = false);
+    // bind current thread to a worker local run queue (called by worker thread)
+    void bind_worker(int worker_idx);
+    // set the notify function, called after push (nullptr to disable)
+    void set_notify(mq_notify_proc notify_func, void* ud);
 
-    // push a service private mq to global mq link list
-    void push(mq_private* q);
-    // pop a service private mq from global mq link list
+    // push a service private mq (local run queue if called by worker thread, else global mq link list)
+    // is_high: the queue has high priority messages pending
+    void push(mq_private* q, bool is_high = false);
+    // call fast path: hand a queue over to current worker (runs after the current message)
+    // return false if not a worker thread, disabled or the handoff slot is taken (the caller should push it)
+    bool handoff(mq_private* q);
+    // current worker has a queue handed off
+    bool is_handoff_pending();
+    // pop a service private mq (handed off queue, local run queue, global mq link list, steal from other workers)
     mq_private* pop();
+    // number of runnable queues (global mq link list and local run queue of current worker, approximate)
+    int length();
+    // number of runnable queues of the node (global mq link list and all local run queues, approximate)
+    int runnable_count();
+    // move the local run queue (and the handed off queue) of current worker to global mq (called by a retiring worker)
+    void drain_worker();
+
+private:
+    // push a service private mq (without notify)
+    void _push(mq_private* q, bool is_high);
+    // push a link list to global mq link list
+    static void _push_global(mq_list& list, mq_private* head, mq_private* tail, int n);
+    // pop from global mq link list
+    static mq_private* _pop_global(mq_list& list);
+    // steal from other workers
+    mq_private* _steal(int worker_idx);
 };
 
 }
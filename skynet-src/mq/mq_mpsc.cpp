@@ -0,0 +1,294 @@
+#include "mq_mpsc.h"
+
+namespace skynet {
+
+mq_mpsc::mq_mpsc()
+{
+    head_ = new segment;
+    head_idx_ = 0;
+    tail_.store(head_);
+    segment_count_.store(1, std::memory_order_relaxed);
+}
+
+mq_mpsc::~mq_mpsc()
+{
+    // no producer now, free all segments
+    segment* seg = head_;
+    while (seg != nullptr)
+    {
+        segment* next = seg->next.load(std::memory_order_relaxed);
+        delete seg;
+        seg = next;
+    }
+
+    delete spare_;
+
+    segment* lists[] = { retired_, pending_ };
+    for (segment* list : lists)
+    {
+        while (list != nullptr)
+        {
+            segment* next = list->retired_next;
+            delete list;
+            list = next;
+        }
+    }
+}
+
+void mq_mpsc::reset()
+{
+    // free the segments after head (a linked spare), the retired segments and the spare
+    segment* seg = head_->next.load(std::memory_order_relaxed);
+    while (seg != nullptr)
+    {
+        segment* next = seg->next.load(std::memory_order_relaxed);
+        delete seg;
+        seg = next;
+    }
+
+    segment* lists[] = { retired_, pending_, spare_ };
+    for (segment* list : lists)
+    {
+        while (list != nullptr)
+        {
+            segment* next = list->retired_next;
+            delete list;
+            list = next;
+        }
+    }
+    retired_ = nullptr;
+    pending_ = nullptr;
+    spare_ = nullptr;
+
+    // reset head segment
+    head_->enqueue_idx.store(0, std::memory_order_relaxed);
+    head_->next.store(nullptr, std::memory_order_relaxed);
+    for (auto& s : head_->slots)
+    {
+        s.ready.store(false, std::memory_order_relaxed);
+    }
+    head_idx_ = 0;
+    idle_rounds_ = 0;
+
+    tail_.store(head_);
+    epoch_.store(0, std::memory_order_relaxed);
+    active_[0].store(0, std::memory_order_relaxed);
+    active_[1].store(0, std::memory_order_relaxed);
+    length_.store(0, std::memory_order_relaxed);
+    peak_length_.store(0, std::memory_order_relaxed);
+    segment_count_.store(1, std::memory_order_relaxed);
+}
+
+void mq_mpsc::push(service_message* message)
+{
+    int length = length_.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (length > peak_length_.load(std::memory_order_relaxed))
+    {
+        peak_length_.store(length, std::memory_order_relaxed);
+    }
+
+    // register as an active producer of current epoch,
+    // retry if the consumer flipped the epoch before we registered.
+    uint32_t epoch = 0;
+    for (;;)
+    {
+        epoch = epoch_.load();
+        active_[epoch & 1].fetch_add(1);
+        if (epoch_.load() == epoch)
+            break;
+
+        active_[epoch & 1].fetch_sub(1);
+    }
+
+    for (;;)
+    {
+        segment* seg = tail_.load(std::memory_order_acquire);
+
+        // reserve a slot
+        int idx = seg->enqueue_idx.fetch_add(1, std::memory_order_relaxed);
+        if (idx < SEGMENT_SIZE)
+        {
+            slot& s = seg->slots[idx];
+            s.message = *message;
+            // publish (seq_cst, pairs with the is_in_global_ handoff in mq_private)
+            s.ready.store(true);
+            break;
+        }
+
+        // segment is full, use next segment (maybe a spare segment linked by consumer) or link a new one
+        segment* next = seg->next.load(std::memory_order_acquire);
+        if (next == nullptr)
+        {
+            segment* new_seg = new segment;
+            if (seg->next.compare_exchange_strong(next, new_seg, std::memory_order_acq_rel, std::memory_order_acquire))
+            {
+                next = new_seg;
+                segment_count_.fetch_add(1, std::memory_order_relaxed);
+            }
+            else
+            {
+                // other producer has linked
+                delete new_seg;
+            }
+        }
+
+        // move tail forward (may be done by other producer)
+        tail_.compare_exchange_strong(seg, next);
+    }
+
+    active_[epoch & 1].fetch_sub(1, std::memory_order_release);
+}
+
+bool mq_mpsc::pop(service_message* message)
+{
+    for (;;)
+    {
+        if (head_idx_ < SEGMENT_SIZE)
+        {
+            slot& s = head_->slots[head_idx_];
+            if (!s.ready.load(std::memory_order_acquire))
+                break;
+
+            *message = s.message;
+            ++head_idx_;
+            length_.fetch_sub(1, std::memory_order_relaxed);
+
+            // busy queue, producers are going to cross the segment, prepare the spare
+            if (spare_ != nullptr && head_->enqueue_idx.load(std::memory_order_relaxed) >= SEGMENT_SIZE / 2 &&
+                length_.load(std::memory_order_relaxed) >= SEGMENT_SIZE / 4)
+            {
+                _link_spare();
+            }
+
+            return true;
+        }
+
+        // head segment drained, move to next segment.
+        // the next segment may be a spare which no producer has moved to, stay until tail_ leaves the head segment,
+        // otherwise the head segment would be recycled while producers still use it as tail.
+        if (tail_.load(std::memory_order_acquire) == head_)
+            break;
+
+        segment* next = head_->next.load(std::memory_order_acquire);
+        segment* seg = head_;
+        head_ = next;
+        head_idx_ = 0;
+        idle_rounds_ = 0;
+        _retire(seg);
+    }
+
+    // queue is empty, good time to reclaim
+    if (pending_ != nullptr || retired_ != nullptr)
+    {
+        _reclaim();
+    }
+    if (spare_ != nullptr)
+    {
+        _shrink();
+    }
+
+    return false;
+}
+
+bool mq_mpsc::empty()
+{
+    segment* seg = head_;
+    int idx = head_idx_;
+    if (idx >= SEGMENT_SIZE)
+    {
+        // seq_cst, a producer moves tail_ before publishing the message in next segment
+        if (tail_.load() == seg)
+            return true;
+
+        seg = seg->next.load();
+        idx = 0;
+    }
+
+    // seq_cst, pairs with the is_in_global_ handoff in mq_private
+    return !seg->slots[idx].ready.load();
+}
+
+void mq_mpsc::_retire(segment* seg)
+{
+    seg->retired_next = retired_;
+    retired_ = seg;
+
+    _reclaim();
+}
+
+void mq_mpsc::_reclaim()
+{
+    // segments retired before last flip, free them if all producers of old epoch have exited
+    if (pending_ != nullptr)
+    {
+        uint32_t epoch = epoch_.load(std::memory_order_relaxed);
+        if (active_[(epoch - 1) & 1].load() != 0)
+            return;
+
+        _recycle(pending_);
+        pending_ = nullptr;
+    }
+
+    if (retired_ == nullptr)
+        return;
+
+    // flip epoch, new producers register to the other parity
+    pending_ = retired_;
+    retired_ = nullptr;
+    uint32_t epoch = epoch_.fetch_add(1) + 1;
+    if (active_[(epoch - 1) & 1].load() == 0)
+    {
+        _recycle(pending_);
+        pending_ = nullptr;
+    }
+}
+
+void mq_mpsc::_recycle(segment* list)
+{
+    while (list != nullptr)
+    {
+        segment* seg = list;
+        list = seg->retired_next;
+
+        // reset segment
+        seg->retired_next = nullptr;
+        seg->enqueue_idx.store(0, std::memory_order_relaxed);
+        seg->next.store(nullptr, std::memory_order_relaxed);
+        for (auto& s : seg->slots)
+        {
+            s.ready.store(false, std::memory_order_relaxed);
+        }
+
+        // keep one spare segment, avoid allocation when producers cross the segment boundary
+        if (spare_ == nullptr)
+        {
+            spare_ = seg;
+            continue;
+        }
+
+        delete seg;
+        segment_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void mq_mpsc::_link_spare()
+{
+    segment* expected = nullptr;
+    if (head_->next.load(std::memory_order_relaxed) == nullptr &&
+        head_->next.compare_exchange_strong(expected, spare_, std::memory_order_release, std::memory_order_relaxed))
+    {
+        spare_ = nullptr;
+    }
+}
+
+void mq_mpsc::_shrink()
+{
+    if (++idle_rounds_ < SHRINK_IDLE_ROUNDS)
+        return;
+
+    delete spare_;
+    spare_ = nullptr;
+    segment_count_.fetch_sub(1, std::memory_order_relaxed);
+}
+
+}
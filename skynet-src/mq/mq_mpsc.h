@@ -0,0 +1,111 @@
+/**
+ * lock-free multi-producer / single-consumer message queue
+ *
+ * 1) messages are stored in a linked list of fixed size segments (SEGMENT_SIZE slots per segment).
+ * 2) producers reserve a slot by fetch_add on the tail segment's enqueue index, write the message,
+ *    and publish it by setting the slot ready flag. when a segment is full, the producer links a new one.
+ * 3) the consumer (the worker thread which dispatching the service) reads slots in order, a slot which
+ *    has been reserved but not yet published is treated as the end of the queue.
+ * 4) drained segments can't be freed immediately, because a producer may still hold a pointer to them.
+ *    they are reclaimed with a two-parity epoch counter: producers register in active_[epoch & 1],
+ *    the consumer flips the epoch and frees the retired segments once the old parity drains to 0.
+ * 5) shrink: a reclaimed segment is kept as a consumer private spare, it is linked to the end of queue only when
+ *    the head segment is half full and the queue has backlog. the spare is freed when the queue has been found
+ *    empty SHRINK_IDLE_ROUNDS times without crossing a segment, so an idle queue holds one segment (two if a spare
+ *    was linked in the last burst) no matter how large its past burst was.
+ */
+
+#pragma once
+
+#include "mq_msg.h"
+
+#include <atomic>
+
+namespace skynet {
+
+class mq_mpsc final
+{
+private:
+    // constants
+    enum
+    {
+        SEGMENT_SIZE = 32,                                  // message slots per segment (a slot holds an inline payload, keep the segment small)
+        SHRINK_IDLE_ROUNDS = 8,                             // free the spare segment after the queue has been found empty this many times
+        CACHE_LINE_SIZE = 64,                               //
+    };
+
+    // message slot
+    struct slot
+    {
+        std::atomic<bool> ready { false };                  // message has been published by producer
+        service_message message;                            //
+    };
+
+    // queue segment
+    struct segment
+    {
+        std::atomic<int> enqueue_idx { 0 };                 // slot reserve index (may exceed SEGMENT_SIZE when full)
+        std::atomic<segment*> next { nullptr };             // next segment
+        segment* retired_next = nullptr;                    // consumer private: retired segment link list
+        slot slots[SEGMENT_SIZE];                           //
+    };
+
+private:
+    // producer side
+    alignas(CACHE_LINE_SIZE) std::atomic<segment*> tail_ { nullptr };   // the segment producers are writing
+    std::atomic<uint32_t> epoch_ { 0 };                                 // reclaim epoch
+    std::atomic<int> active_[2] = { { 0 }, { 0 } };                     // producers in flight, index by epoch parity
+    std::atomic<int> length_ { 0 };                                     // number of messages (include reserved slots)
+    std::atomic<int> peak_length_ { 0 };                                // max number of messages (stat)
+    std::atomic<int> segment_count_ { 0 };                              // number of segments allocated (stat)
+
+    // consumer side
+    alignas(CACHE_LINE_SIZE) segment* head_ = nullptr;  // the segment consumer is reading
+    int head_idx_ = 0;                                  // read index in head segment
+    segment* retired_ = nullptr;                        // drained segments, wait for next epoch flip
+    segment* pending_ = nullptr;                        // drained segments, wait for old epoch producers exit
+    segment* spare_ = nullptr;                          // reclaimed segment, not linked yet
+    int idle_rounds_ = 0;                               // number of times found empty since the last segment crossing
+
+public:
+    mq_mpsc();
+    ~mq_mpsc();
+
+    mq_mpsc(const mq_mpsc&) = delete;
+    mq_mpsc& operator=(const mq_mpsc&) = delete;
+
+public:
+    // push a message, thread safe (any thread)
+    void push(service_message* message);
+    // pop a message, consumer only. return false if queue is empty
+    bool pop(service_message* message);
+    // check the next message has been published, consumer only
+    bool empty();
+
+    // reset to the initial state for reuse, keep the head segment only (no producer, consumer only)
+    void reset();
+    // number of messages
+    int length();
+    // max number of messages ever queued
+    int peak_length();
+    // number of message slots allocated (include the spare segment)
+    int slot_count();
+    // memory allocated by segments (bytes)
+    size_t memory_usage();
+
+private:
+    // consumer: retire drained head segment
+    void _retire(segment* seg);
+    // consumer: free or reuse the retired segments which no producer can access
+    void _reclaim();
+    // consumer: reset a reclaimed segment and keep it as spare, or free it
+    void _recycle(segment* list);
+    // consumer: link the spare segment to the end of queue
+    void _link_spare();
+    // consumer: free the spare segment if the queue keeps idle
+    void _shrink();
+};
+
+}
+
+#include "mq_mpsc.inl"
@@ -0,0 +1,23 @@
+namespace skynet {
+
+inline int mq_mpsc::length()
+{
+    return length_.load(std::memory_order_relaxed);
+}
+
+inline int mq_mpsc::peak_length()
+{
+    return peak_length_.load(std::memory_order_relaxed);
+}
+
+inline int mq_mpsc::slot_count()
+{
+    return segment_count_.load(std::memory_order_relaxed) * SEGMENT_SIZE;
+}
+
+inline size_t mq_mpsc::memory_usage()
+{
+    return segment_count_.load(std::memory_order_relaxed) * sizeof(segment);
+}
+
+}
@@ -32,13 +32,21 @@ enum service_message_type
 #define MESSAGE_TAG_ALLOC_SESSION 0x20000               // set in svc_msg_type when sending a package
                                                         // send api method will ignore session arguemnts and allocate a new session id.
 
+// small message payload (include the '\0' terminator) is stored in the message itself, not allocated
+#define MESSAGE_INLINE_SIZE 48
+
 // skynet service message, used for interaction between services
 struct service_message
 {
     uint32_t src_svc_handle = 0;                        // source service handle
     int session_id = 0;                                 // message session id
-    void* data_ptr = nullptr;                           // message data
+    void* data_ptr = nullptr;                           // message data (inline message: nullptr in mailbox, points to inline_data after popped)
     size_t data_size = 0;                               // message data size, high 8 bits: message type
+    uint64_t enqueue_ns = 0;                            // enqueue time (monotonic ns), stamped by mq_private
+    bool is_inline = false;                             // payload is stored in inline_data, don't delete data_ptr
+    bool is_deferred = false;                           // has been deferred to the queue tail by overload control
+    bool is_deadline = false;                           // call deadline error, delivered by timer (see service_session)
+    alignas(8) char inline_data[MESSAGE_INLINE_SIZE];   // inline payload
 };
 
 //
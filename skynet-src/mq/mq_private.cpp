@@ -14,167 +14,336 @@
 #include "mq_private.h"
 #include "mq_global.h"
 
+#include "../utils/time_helper.h"
+
 #include <cassert>
 
 namespace skynet {
 
+std::mutex mq_private::free_mutex_;
+mq_private* mq_private::free_list_ = nullptr;
+int mq_private::free_count_ = 0;
+
 mq_private* mq_private::create(uint32_t svc_handle)
 {
-    mq_private* q = new mq_private;
+    // reuse a released queue
+    mq_private* q = nullptr;
+    {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        if (free_list_ != nullptr)
+        {
+            q = free_list_;
+            free_list_ = q->next_;
+            --free_count_;
+        }
+    }
+    if (q == nullptr)
+        q = new mq_private;
+
     q->svc_handle_ = svc_handle;
-    q->cap_ = DEFAULT_QUEUE_CAPACITY;
-    q->head_ = 0;
-    q->tail_ = 0;
 
     // When the queue is create (always between service create and service init),
     // set in_global flag to avoid push it to global queue.
-    // If the service init success, service_manager::instance()->create_service() will call mq_private->push to push it to global queue.
+    // If the service init success, service_manager::instance()->create_service() will push it to global queue (or start its exclusive thread).
     q->is_in_global_ = true;
     q->is_release_ = false;
     q->overload_ = 0;
     q->overload_threshold_ = DEFAULT_OVERLOAD_THRESHOLD;
-
-    // 分配cap个skynet_message大小容量
-    q->queue_ = new service_message[q->cap_];
     q->next_ = nullptr;
 
     return q;
 }
 
+void mq_private::_recycle(mq_private* q)
+{
+    // reset (no producer now), keep the segments allocated by the lanes
+    for (int i = 0; i < LANE_COUNT; i++)
+    {
+        q->lanes_[i].reset();
+        q->lane_pop_count_[i] = 0;
+    }
+    q->is_low_.store(false, std::memory_order_relaxed);
+    q->capacity_.store(0, std::memory_order_relaxed);
+    q->policy_.store(POLICY_REJECT, std::memory_order_relaxed);
+    q->reject_count_.store(0, std::memory_order_relaxed);
+    q->overload_count_.store(0, std::memory_order_relaxed);
+    q->drop_count_ = 0;
+    q->codel_.reset();
+    q->wakeup_func_ = nullptr;
+    q->wakeup_ud_ = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(free_mutex_);
+        if (free_count_ < FREE_MAX)
+        {
+            q->next_ = free_list_;
+            free_list_ = q;
+            ++free_count_;
+            return;
+        }
+    }
+
+    delete q;
+}
+
 void mq_private::mark_release()
 {
-    std::lock_guard<std::mutex> lock(mutex_);
+    assert(!is_release_);
+
+    // take the ownership before marking release: the owner drops (and frees) the queue once it sees is_release_,
+    // so `this` is touched after the mark only if the ownership is taken here.
+    bool is_owned = !is_in_global_.exchange(true);
 
     // marked release
-    assert(!is_release_);
-    is_release_ = true;
+    is_release_.store(true);
 
     // not in global message queue
-    if (!is_in_global_)
+    if (is_owned)
     {
-        mq_global::instance()->push(this);
+        _schedule(false);
     }
 }
 
 void mq_private::release(message_drop_proc drop_func, void* ud)
 {
-    std::unique_lock<std::mutex> lock(mutex_);
-
     // has marked release, 说明ctx真正delete了，才能释放掉队列，否则继续push到全局队列，等待下一次调度
-    if (is_release_)
+    if (is_release_.load())
     {
-        lock.unlock();
         _drop_queue(this, drop_func, ud);
     }
     else
     {
-        mq_global::instance()->push(this);
-        lock.unlock();
+        _schedule(false);
     }
 }
 
+void mq_private::set_exclusive(queue_wakeup_proc wakeup_func, void* ud)
+{
+    wakeup_func_ = wakeup_func;
+    wakeup_ud_ = ud;
+}
 
 // 向消息队列里push消息
 void mq_private::push(service_message* message)
 {
     assert(message != nullptr);
 
-    std::lock_guard<std::mutex> lock(mutex_);
+    // publish message
+    message->enqueue_ns = time_helper::get_time_ns();
+    int lane = _lane_of(message);
+    lanes_[lane].push(message);
 
-    // 入队, 因为是循环数组，越界了要重头开始
-    // 存到尾部，然后尾部+1，如果超过容量，则重置为0
-    queue_[tail_] = *message;
-    if (++tail_ >= cap_)
+    // not in global mq, push back
+    // (load first, the exchange is only needed when the queue is idle)
+    if (!is_in_global_.load() && !is_in_global_.exchange(true))
     {
-        tail_ = 0;
+        _schedule(lane == LANE_HIGH, message->session_id != 0);
     }
+}
 
-    // queue is full, need expand
-    if (head_ == tail_)
+void mq_private::push_batch(service_message* messages, int count)
+{
+    assert(messages != nullptr);
+
+    // publish messages
+    uint64_t now_ns = time_helper::get_time_ns();
+    bool is_high = false;
+    for (int i = 0; i < count; i++)
     {
-        _expand_queue();
+        messages[i].enqueue_ns = now_ns;
+        int lane = _lane_of(&messages[i]);
+        lanes_[lane].push(&messages[i]);
+        is_high = is_high || lane == LANE_HIGH;
     }
 
     // not in global mq, push back
-    if (!is_in_global_)
+    if (count > 0 && !is_in_global_.load() && !is_in_global_.exchange(true))
     {
-        is_in_global_ = true;
-        mq_global::instance()->push(this);
+        _schedule(is_high);
     }
 }
 
-// 从私有队列里pop一个消息
-bool mq_private::pop(service_message* message)
+int mq_private::push_bounded(service_message* message)
 {
-    bool is_empty = true;
-
-    std::lock_guard<std::mutex> lock(mutex_);
+    assert(message != nullptr);
 
-    // queue is not empty
-    if (head_ != tail_)
+    int result = PUSH_OK;
+    int capacity = capacity_.load(std::memory_order_relaxed);
+    if (capacity > 0 && _lane_of(message) == LANE_NORMAL)
     {
-        //
-        *message = queue_[head_++];
-
-        is_empty = false;
-        int head = head_;
-        int tail = tail_;
-        int cap = cap_;
-
-        // 因为是循环数组，超出边界后要重头开始，所以设为0
-        if (head >= cap)
+        // approximate, producers may race over the capacity a little
+        int length = lanes_[LANE_NORMAL].length();
+        if (length >= capacity)
         {
-            head_ = head = 0;
+            int policy = policy_.load(std::memory_order_relaxed);
+            if (policy == POLICY_THROTTLE)
+            {
+                result = PUSH_THROTTLE;
+            }
+            // drop oldest: trimmed by the consumer, reject only if the consumer can't keep up
+            else if (policy == POLICY_REJECT || length >= capacity * 2)
+            {
+                reject_count_.fetch_add(1, std::memory_order_relaxed);
+                return PUSH_REJECT;
+            }
         }
-        // 如果数组被循环使用了，那么tail < head
-        int length = tail - head;
-        if (length < 0)
+    }
+
+    push(message);
+
+    return result;
+}
+
+// 从私有队列里pop一个消息
+bool mq_private::pop(service_message* message)
+{
+    for (;;)
+    {
+        // high priority lane first
+        int lane = LANE_HIGH;
+        while (lane < LANE_COUNT && !lanes_[lane].pop(message))
         {
-            length += cap;
+            ++lane;
         }
-        // 长度要超过阀值了，扩容一倍
-        while (length > overload_threshold_)
+        if (lane < LANE_COUNT)
         {
-            overload_ = length;
-            overload_threshold_ *= 2;
+            ++lane_pop_count_[lane];
+            // inline payload, refer to the popped copy
+            if (message->is_inline)
+                message->data_ptr = message->inline_data;
+            break;
         }
+
+        if (_give_up())
+            return true;
     }
-    else
+
+    // 长度要超过阀值了，扩容一倍
+    int length = this->length();
+    while (length > overload_threshold_)
     {
-        // reset overload_threshold when queue is empty
-        overload_threshold_ = DEFAULT_OVERLOAD_THRESHOLD;
+        overload_ = length;
+        overload_threshold_ *= 2;
+        overload_count_.store(overload_count_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
     }
 
-    if (is_empty)
+    return false;
+}
+
+bool mq_private::try_give_up()
+{
+    return _is_empty() && _give_up();
+}
+
+int mq_private::trim(message_drop_proc drop_func, void* ud)
+{
+    int capacity = capacity_.load(std::memory_order_relaxed);
+    if (capacity <= 0 || policy_.load(std::memory_order_relaxed) != POLICY_DROP_OLDEST)
+        return 0;
+
+    int count = lanes_[LANE_NORMAL].length() - capacity;
+    int dropped = 0;
+    service_message msg;
+    while (dropped < count && lanes_[LANE_NORMAL].pop(&msg))
+    {
+        if (msg.is_inline)
+            msg.data_ptr = msg.inline_data;
+        drop_func(&msg, ud);
+        ++dropped;
+    }
+    drop_count_ += dropped;
+
+    return dropped;
+}
+
+int mq_private::on_dequeue(service_message* message, uint64_t now_ns)
+{
+    int action = codel_.on_dequeue(message, now_ns);
+    if (action == mq_codel::ACTION_DEFER)
     {
-        is_in_global_ = false;
+        // the consumer owns the queue, no handoff. keep enqueue_ns, the waiting time accumulates.
+        message->is_deferred = true;
+        if (message->is_inline)
+            message->data_ptr = nullptr;
+        lanes_[_lane_of(message)].push(message);
     }
 
-    return is_empty;
+    return action;
 }
 
-// 获取队列长度，注意数组被循环使用的情况
+void mq_private::set_capacity(int capacity, int policy)
+{
+    capacity_.store(capacity > 0 ? capacity : 0, std::memory_order_relaxed);
+    policy_.store(policy, std::memory_order_relaxed);
+}
+
+int mq_private::capacity()
+{
+    return capacity_.load(std::memory_order_relaxed);
+}
+
+// 获取队列长度
 int mq_private::length()
 {
-    //
-    int head, tail, cap;
+    int length = 0;
+    for (auto& lane : lanes_)
     {
-        std::lock_guard<std::mutex> lock(mutex_);
+        length += lane.length();
+    }
+
+    return length;
+}
+
+int mq_private::lane_length(int lane)
+{
+    assert(lane >= 0 && lane < LANE_COUNT);
+
+    return lanes_[lane].length();
+}
+
+uint64_t mq_private::lane_pop_count(int lane)
+{
+    assert(lane >= 0 && lane < LANE_COUNT);
 
-        head = this->head_;
-        tail = this->tail_;
-        cap = this->cap_;
+    return lane_pop_count_[lane];
+}
+
+int mq_private::peak_length()
+{
+    int peak_length = 0;
+    for (auto& lane : lanes_)
+    {
+        peak_length += lane.peak_length();
     }
 
-    // 还没有循环使用数组的时候
-    if (head <= tail)
+    return peak_length;
+}
+
+int mq_private::slot_count()
+{
+    int slot_count = 0;
+    for (auto& lane : lanes_)
     {
-        return tail - head;
+        slot_count += lane.slot_count();
     }
-    else
+
+    return slot_count;
+}
+
+size_t mq_private::memory_usage()
+{
+    size_t memory_usage = sizeof(mq_private);
+    for (auto& lane : lanes_)
     {
-        return tail + cap - head;
+        memory_usage += lane.memory_usage();
     }
+
+    return memory_usage;
+}
+
+bool mq_private::is_high_pending()
+{
+    return !lanes_[LANE_HIGH].empty();
 }
 
 int mq_private::overload()
@@ -194,42 +363,72 @@ uint32_t mq_private::svc_handle()
     return svc_handle_;
 }
 
-// 准备释放队列, 释放服务，清空循环数组
-void mq_private::_drop_queue(mq_private* q, message_drop_proc drop_func, void* ud)
+int mq_private::_lane_of(service_message* message)
 {
-    service_message msg;
+    int svc_msg_type = message->data_size >> MESSAGE_TYPE_SHIFT;
+    switch (svc_msg_type)
+    {
+    case SERVICE_MSG_TYPE_RESPONSE:
+    case SERVICE_MSG_TYPE_SYSTEM:
+    case SERVICE_MSG_TYPE_ERROR:
+        return LANE_HIGH;
+    default:
+        return LANE_NORMAL;
+    }
+}
 
-    // drop all
-    while (!q->pop(&msg))
+bool mq_private::_is_empty()
+{
+    // seq_cst, pairs with the is_in_global_ handoff
+    for (auto& lane : lanes_)
     {
-        drop_func(&msg, ud);
+        if (!lane.empty())
+            return false;
     }
 
-    assert(q->next_ == nullptr);
+    return true;
+}
 
-    //
-    delete[] q->queue_;
-    delete q;
+bool mq_private::_give_up()
+{
+    // reset overload_threshold when queue is empty
+    overload_threshold_ = DEFAULT_OVERLOAD_THRESHOLD;
+
+    // give up the ownership
+    is_in_global_.store(false);
+
+    // a message may be published before is_in_global_ reset, and its producer saw is_in_global_ == true.
+    // check again, take back the ownership if no producer did it.
+    return _is_empty() || is_in_global_.exchange(true);
 }
 
-void mq_private::_expand_queue()
+void mq_private::_schedule(bool is_high, bool is_call/* = false*/)
 {
-    service_message* new_queue = new service_message[cap_ * 2];
+    if (wakeup_func_ != nullptr)
+    {
+        wakeup_func_(wakeup_ud_);
+    }
+    else if (!is_call || !mq_global::instance()->handoff(this))
+    {
+        mq_global::instance()->push(this, is_high);
+    }
+}
 
-    // copy old data
-    for (int i = 0; i < cap_; i++)
+// 准备释放队列, 释放服务，清空消息队列
+void mq_private::_drop_queue(mq_private* q, message_drop_proc drop_func, void* ud)
+{
+    service_message msg;
+
+    // drop all
+    while (!q->pop(&msg))
     {
-        new_queue[i] = queue_[(head_ + i) % cap_];
+        drop_func(&msg, ud);
     }
-    head_ = 0;      // reset ring buffer head
-    tail_ = cap_;   // reset ring buffer tail
-    cap_ *= 2;      // double capacity
 
-    // release old data
-    delete[] queue_;
+    assert(q->next_ == nullptr);
 
-    queue_ = new_queue;
+    //
+    _recycle(q);
 }
 
 }
-
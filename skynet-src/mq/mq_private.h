@@ -4,9 +4,13 @@
 
 #pragma once
 
+#include "mq_mpsc.h"
+#include "mq_codel.h"
+
 #include <stdlib.h>
 #include <stdint.h>
 
+#include <atomic>
 #include <mutex>
 
 namespace skynet {
@@ -16,10 +20,33 @@ struct service_message;
 
 // message drop function
 typedef void (*message_drop_proc)(service_message* message, void* ud);
+// queue wakeup function (exclusive service)
+typedef void (*queue_wakeup_proc)(void* ud);
 
 /**
  * service private message queue (one per service)
  * memory alginment for performance
+ *
+ * lock-free: any thread can push, only the worker which owns the queue (is_in_global_ == true) can pop.
+ * is_in_global_ handoff:
+ * 1) producer publish the message first, then exchange is_in_global_ false -> true, the winner push the queue to global mq.
+ * 2) consumer find the queue empty, store is_in_global_ = false, then check again,
+ *    if a message arrived meanwhile, it try to take back the ownership by the same exchange.
+ *
+ * priority lanes: response (include timer wakeup), system and error messages go to the high lane, which is popped first.
+ * a queue made runnable by a high lane message is scheduled on the priority path of global mq.
+ * a queue made runnable by a call request or response (session != 0) may be handed off to the sending worker (call fast path).
+ *
+ * exclusive service: the queue never goes to global mq, the winner of the handoff wakes up the service's own thread instead.
+ *
+ * bounded mailbox: the normal lane can be bounded by a capacity (0: unlimited, default), only service sends are checked (push_bounded),
+ * response/system/error messages and messages from node (socket, timer, log) are never limited.
+ *
+ * sojourn time: messages are timestamped at enqueue, the consumer measures the waiting time at dequeue (on_dequeue),
+ * and sheds or defers droppable messages when the waiting time stays above target (see mq_codel).
+ *
+ * recycle: a released queue is reset (one segment per lane kept) and kept in a free list (up to FREE_MAX),
+ * create() takes from the free list first, so service churn doesn't allocate mailboxes.
  */
 class mq_private
 {
@@ -27,27 +54,66 @@ private:
     // constants
     enum
     {
-        DEFAULT_QUEUE_CAPACITY = 64,                        // default ring buffer size
         DEFAULT_OVERLOAD_THRESHOLD = 1024,                  // default overload threshold
+        FREE_MAX = 1024,                                    // max queues kept in the free list
     };
 
 public:
-    std::mutex mutex_;                                      // message ring buffer protect
+    // message lanes
+    enum lane
+    {
+        LANE_HIGH = 0,                                      // response, system, error
+        LANE_NORMAL = 1,                                    // others
+        LANE_COUNT = 2,                                     //
+    };
+
+    // mailbox capacity policies (what to do when the normal lane is full)
+    enum capacity_policy
+    {
+        POLICY_REJECT = 0,                                  // reject the new message, the sender gets an error
+        POLICY_DROP_OLDEST = 1,                             // accept, the oldest messages are dropped before the service dispatches (hard limit: 2 * capacity)
+        POLICY_THROTTLE = 2,                                // accept, signal the sender to throttle
+    };
+
+    // push_bounded() results
+    enum push_result
+    {
+        PUSH_OK = 0,                                        // accepted
+        PUSH_THROTTLE = 1,                                  // accepted, but the mailbox is full (POLICY_THROTTLE)
+        PUSH_REJECT = -1,                                   // rejected, the mailbox is full
+    };
 
+public:
     uint32_t svc_handle_ = 0;                               // the service handle to which it belongs
-    bool is_release_ = false;                               // release mark（当delete ctx时会设置此标记）
-    bool is_in_global_ = true;                              // false: not in global mq; true: in global mq, or the message is dispatching.
+    std::atomic<bool> is_release_ { false };                // release mark（当delete ctx时会设置此标记）
+    std::atomic<bool> is_in_global_ { true };               // false: not in global mq; true: in global mq, or the message is dispatching.
+    std::atomic<bool> is_low_ { false };                    // over cpu quota, scheduled after the other queues (see node cpu quota)
+
+    int overload_ = 0;                                      // current overload (consumer only)
+    std::atomic<uint64_t> overload_count_ { 0 };            // number of times the queue length crossed the overload threshold (written by consumer)
+    int overload_threshold_ = DEFAULT_OVERLOAD_THRESHOLD;   // 过载阈值，初始是MQ_OVERLOAD (consumer only)
+
+    mq_mpsc lanes_[LANE_COUNT];                             // lock-free message queue, one per lane
+    uint64_t lane_pop_count_[LANE_COUNT] = { 0, 0 };        // number of messages popped from each lane (consumer only)
 
-    int overload_ = 0;                                      // current overload
-    int overload_threshold_ = DEFAULT_OVERLOAD_THRESHOLD;   // 过载阈值，初始是MQ_OVERLOAD
+    std::atomic<int> capacity_ { 0 };                       // normal lane capacity, 0: unlimited
+    std::atomic<int> policy_ { POLICY_REJECT };             // capacity policy
+    std::atomic<uint64_t> reject_count_ { 0 };              // number of messages rejected by capacity
+    uint64_t drop_count_ = 0;                               // number of messages dropped by POLICY_DROP_OLDEST (consumer only)
 
-    int cap_ = DEFAULT_QUEUE_CAPACITY;                      // message ring buffer capacity
-    int head_ = 0;                                          // message ring buffer header
-    int tail_ = 0;                                          // message ring buffer tailer
-    service_message* queue_ = nullptr;                      // message ring buffer
+    mq_codel codel_;                                        // sojourn time tracking & overload control (consumer only)
 
     mq_private* next_ = nullptr;                            // link list: next message queue ptr
 
+    queue_wakeup_proc wakeup_func_ = nullptr;               // exclusive service: wakeup its own thread instead of push to global mq
+    void* wakeup_ud_ = nullptr;                             //
+
+private:
+    // free list (linked by next_)
+    static std::mutex free_mutex_;                          //
+    static mq_private* free_list_;                          //
+    static int free_count_;                                 //
+
 public:
     // factory method, create a service private message queue
     static mq_private* create(uint32_t svc_handle);
@@ -55,25 +121,65 @@ public:
     void mark_release();
     // 尝试释放私有队列
     void release(message_drop_proc drop_func, void* ud);
+    // bind to an exclusive thread, must be called before the queue is scheduled
+    void set_exclusive(queue_wakeup_proc wakeup_func, void* ud);
 
 public:
     // 0 for success
     void push(service_message* message);
+    // push messages, only one handoff for all messages
+    void push_batch(service_message* messages, int count);
+    // push with capacity check, return push_result (the message is not taken if rejected)
+    int push_bounded(service_message* message);
     bool pop(service_message* message);
+    // give up the ownership if the queue is empty (consumer only), return true if given up (like pop() return true)
+    bool try_give_up();
+    // POLICY_DROP_OLDEST: drop the oldest messages beyond capacity (consumer only), return the number of messages dropped
+    int trim(message_drop_proc drop_func, void* ud);
+    // measure the sojourn time of a popped message (consumer only), return mq_codel::action
+    // ACTION_DEFER: the message has been pushed back to the queue tail
+    int on_dequeue(service_message* message, uint64_t now_ns);
+
+    // set mailbox capacity (0: unlimited) and policy
+    void set_capacity(int capacity, int policy);
+    // normal lane capacity, 0: unlimited
+    int capacity();
 
     // return the length of message queue, for debug
     int length();
+    // return the length of a lane
+    int lane_length(int lane);
+    // return the number of messages popped from a lane (consumer only)
+    uint64_t lane_pop_count(int lane);
+    // max number of messages ever queued (sum of lanes)
+    int peak_length();
+    // number of message slots allocated (sum of lanes)
+    int slot_count();
+    // memory allocated by the queue (bytes)
+    size_t memory_usage();
+    // has high priority message pending (consumer only)
+    bool is_high_pending();
     // 获取负载情况
     int overload();
 
     uint32_t svc_handle();
 
 private:
-    // 扩展循环数组
-    void _expand_queue();
+    // message lane by message type
+    static int _lane_of(service_message* message);
+    // all lanes are empty (consumer only)
+    bool _is_empty();
+    // queue is empty, give up the ownership, return false if a message arrived meanwhile and the ownership is taken back
+    bool _give_up();
+
+    // schedule the queue (push to global mq, or wakeup exclusive thread)
+    // is_call: made runnable by a call request or response, try the call fast path
+    void _schedule(bool is_high, bool is_call = false);
 
     // 释放队列, 释放服务，清空循环数组
     static void _drop_queue(mq_private* q, message_drop_proc drop_func, void* ud);
+    // reset a dropped queue and put it to the free list, or delete it if the free list is full
+    static void _recycle(mq_private* q);
 };
 
 }
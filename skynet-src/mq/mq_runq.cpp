@@ -0,0 +1,130 @@
+#include "mq_runq.h"
+#include "mq_private.h"
+
+namespace skynet {
+
+mq_runq::mq_runq()
+{
+    for (auto& q : ring_)
+    {
+        q.store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+bool mq_runq::push(mq_private* q)
+{
+    uint32_t head = head_.load(std::memory_order_acquire);
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head >= CAPACITY)
+        return false;
+
+    ring_[tail & (CAPACITY - 1)].store(q, std::memory_order_relaxed);
+    // publish to thieves
+    tail_.store(tail + 1, std::memory_order_release);
+
+    return true;
+}
+
+mq_private* mq_runq::push_next(mq_private* q)
+{
+    return runnext_.exchange(q, std::memory_order_acq_rel);
+}
+
+mq_private* mq_runq::pop()
+{
+    // high priority queue
+    if (runnext_.load(std::memory_order_relaxed) != nullptr)
+    {
+        mq_private* q = runnext_.exchange(nullptr, std::memory_order_acq_rel);
+        if (q != nullptr)
+            return q;
+    }
+
+    for (;;)
+    {
+        uint32_t head = head_.load(std::memory_order_acquire);
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        if (head == tail)
+            return nullptr;
+
+        mq_private* q = ring_[head & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (head_.compare_exchange_weak(head, head + 1, std::memory_order_release, std::memory_order_relaxed))
+            return q;
+    }
+}
+
+int mq_runq::pop_half(mq_private*& head, mq_private*& tail)
+{
+    for (;;)
+    {
+        uint32_t h = head_.load(std::memory_order_acquire);
+        uint32_t t = tail_.load(std::memory_order_relaxed);
+        uint32_t n = (t - h) / 2;
+        if (n == 0)
+            return 0;
+
+        // read first, the slots are only valid if the CAS success
+        mq_private* batch[CAPACITY / 2];
+        for (uint32_t i = 0; i < n; i++)
+        {
+            batch[i] = ring_[(h + i) & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        }
+        if (!head_.compare_exchange_weak(h, h + n, std::memory_order_release, std::memory_order_relaxed))
+            continue;
+
+        // link
+        for (uint32_t i = 0; i < n - 1; i++)
+        {
+            batch[i]->next_ = batch[i + 1];
+        }
+        batch[n - 1]->next_ = nullptr;
+        head = batch[0];
+        tail = batch[n - 1];
+
+        return static_cast<int>(n);
+    }
+}
+
+mq_private* mq_runq::steal(mq_runq* victim)
+{
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        uint32_t h = victim->head_.load(std::memory_order_acquire);
+        uint32_t t = victim->tail_.load(std::memory_order_acquire);
+        uint32_t n = t - h;
+        n = n - n / 2;
+        if (n == 0)
+        {
+            // nothing in the ring, take the high priority queue
+            if (victim->runnext_.load(std::memory_order_relaxed) == nullptr)
+                return nullptr;
+
+            return victim->runnext_.exchange(nullptr, std::memory_order_acq_rel);
+        }
+
+        // inconsistent head/tail (head moved by others), retry
+        if (n > CAPACITY / 2)
+            continue;
+
+        // copy into own ring (after own tail, invisible to thieves until tail_ published)
+        for (uint32_t i = 0; i < n; i++)
+        {
+            mq_private* q = victim->ring_[(h + i) & (CAPACITY - 1)].load(std::memory_order_relaxed);
+            ring_[(tail + i) & (CAPACITY - 1)].store(q, std::memory_order_relaxed);
+        }
+        if (!victim->head_.compare_exchange_weak(h, h + n, std::memory_order_acq_rel, std::memory_order_relaxed))
+            continue;
+
+        // return the last one, publish the others
+        mq_private* q = ring_[(tail + n - 1) & (CAPACITY - 1)].load(std::memory_order_relaxed);
+        if (n > 1)
+        {
+            tail_.store(tail + n - 1, std::memory_order_release);
+        }
+
+        return q;
+    }
+}
+
+}
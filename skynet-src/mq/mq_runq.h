@@ -0,0 +1,63 @@
+/**
+ * worker local run queue
+ *
+ * 1) a bounded ring of runnable service private queues, one per worker thread.
+ * 2) only the owner worker pushes (tail_), the owner and the thieves (other workers) pop by CAS on head_.
+ * 3) a thief grabs half of the victim's queue at once, so an idle worker doesn't come back for each queue.
+ * 4) runnext_ holds one high priority queue (has response/system message pending), it runs before the ring.
+ *    thieves take it only when the ring is empty.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace skynet {
+
+// forward declare
+class mq_private;
+
+class mq_runq final
+{
+public:
+    // constants
+    enum
+    {
+        CAPACITY = 256,                                     // ring capacity (power of 2)
+        CACHE_LINE_SIZE = 64,                               //
+    };
+
+private:
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> head_ { 0 };     // consume index (owner & thieves)
+    alignas(CACHE_LINE_SIZE) std::atomic<uint32_t> tail_ { 0 };     // produce index (owner only)
+    std::atomic<mq_private*> ring_[CAPACITY];                       //
+    std::atomic<mq_private*> runnext_ { nullptr };                  // high priority queue (owner & thieves)
+
+public:
+    mq_runq();
+    ~mq_runq() = default;
+
+    mq_runq(const mq_runq&) = delete;
+    mq_runq& operator=(const mq_runq&) = delete;
+
+public:
+    // owner: push a queue, return false if the ring is full
+    bool push(mq_private* q);
+    // owner: push a high priority queue to runnext, return the queue kicked out (should be pushed to ring)
+    mq_private* push_next(mq_private* q);
+    // owner: pop a queue (runnext first), return nullptr if empty
+    mq_private* pop();
+    // owner: take half of the queues out as a link list (for overflow into global mq), return the number of queues
+    int pop_half(mq_private*& head, mq_private*& tail);
+
+    // owner: steal half of the victim's queues into this ring (must be empty), return one of them (nullptr if nothing stolen)
+    mq_private* steal(mq_runq* victim);
+
+    // number of queues (approximate)
+    int length();
+};
+
+}
+
+#include "mq_runq.inl"
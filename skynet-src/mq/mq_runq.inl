@@ -0,0 +1,11 @@
+namespace skynet {
+
+inline int mq_runq::length()
+{
+    uint32_t head = head_.load(std::memory_order_relaxed);
+    uint32_t tail = tail_.load(std::memory_order_relaxed);
+    int n = static_cast<int>(tail - head);
+    return runnext_.load(std::memory_order_relaxed) != nullptr ? n + 1 : n;
+}
+
+}
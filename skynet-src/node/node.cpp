@@ -2,6 +2,8 @@
 #include "node_thread.h"
 #include "node_config.h"
 #include "node_socket.h"
+#include "node_exclusive.h"
+#include "node_record.h"
 
 #include "../mq/mq_msg.h"
 #include "../mq/mq_private.h"
@@ -15,6 +17,7 @@
 #include "../service/service_context.h"
 #include "../service/service_monitor.h"
 #include "../service/service_manager.h"
+#include "../service/service_multicast.h"
 
 #include "../mod/mod_manager.h"
 
@@ -22,8 +25,10 @@
 #include "../utils/time_helper.h"
 
 #include <regex>
+#include <cstring>
 #include <iostream>
 #include <mutex>
+#include <thread>
 
 namespace skynet {
 
@@ -43,10 +48,28 @@ struct drop_t
     uint32_t svc_handle;
 };
 
+// free message data (multicast message refers to a shared package)
+static void free_message(service_message* msg)
+{
+    // inline payload, nothing to free
+    if (msg->is_inline)
+        return;
+
+    int svc_msg_type = msg->data_size >> MESSAGE_TYPE_SHIFT;
+    if (svc_msg_type == SERVICE_MSG_TYPE_MULTICAST)
+    {
+        service_multicast::release_package((multicast_package*)msg->data_ptr);
+    }
+    else
+    {
+        delete[] msg->data_ptr;
+    }
+}
+
 static void drop_message(service_message* msg, void* ud)
 {
     drop_t* d = (drop_t*)ud;
-    delete[] msg->data_ptr;
+    free_message(msg);
 
     uint32_t src_svc_handle = d->svc_handle;
     assert(src_svc_handle != 0);
@@ -55,6 +78,19 @@ static void drop_message(service_message* msg, void* ud)
     service_manager::instance()->send(nullptr, src_svc_handle, msg->src_svc_handle, SERVICE_MSG_TYPE_ERROR, 0, nullptr, 0);
 }
 
+// drop a message beyond mailbox capacity (POLICY_DROP_OLDEST), or shed by sojourn time overload control
+static void trim_message(service_message* msg, void* ud)
+{
+    drop_t* d = (drop_t*)ud;
+    free_message(msg);
+
+    // report error to the requester, the call will fail. (not for session 0: session 0 is a send, nobody waits for a reply)
+    if (msg->session_id != 0)
+    {
+        service_manager::instance()->send(nullptr, d->svc_handle, msg->src_svc_handle, SERVICE_MSG_TYPE_ERROR, msg->session_id, nullptr, 0);
+    }
+}
+
 bool node::init(const std::string config_filename)
 {
     // initialize skynet node lua code cache
@@ -93,13 +129,18 @@ void node::start()
     //
     service_manager::instance()->init();
     //
-    mq_global::instance()->init();
+    mq_global::instance()->init(config_.thread_max_, config_.call_fastpath_ != 0);
     //
     mod_manager::instance()->init(config_.cservice_path_);
     //
     timer_manager::instance()->init();
     //
     node_socket::instance()->init();
+    // record/replay the external inputs
+    if (!node_record::instance()->init(config_))
+    {
+        ::exit(1);
+    }
 
     // enable/disable profiler
     enable_profiler(config_.profile_);
@@ -114,10 +155,26 @@ void node::start()
     service_manager::instance()->set_handle_by_name("logger", log_svc_ctx->svc_handle_);
 
     // bootstrap to load snlua c service
-    _bootstrap(log_svc_ctx, config_.bootstrap_);
+    if (node_record::instance()->is_replaying())
+    {
+        _bootstrap(log_svc_ctx, node_record::instance()->replay_bootstrap());
+        node_record::instance()->start_replay();
+    }
+    else
+    {
+        if (node_record::instance()->is_recording())
+            node_record::instance()->record_bootstrap(config_.bootstrap_);
+        _bootstrap(log_svc_ctx, config_.bootstrap_);
+    }
 
     // start server threads
-    node_thread::start(config_.thread_);
+    node_thread::start(config_);
+
+    // wait exclusive service threads exit
+    node_exclusive::instance()->fini();
+
+    //
+    node_record::instance()->fini();
 
     //
     node_socket::instance()->fini();
@@ -129,7 +186,7 @@ void node::start()
     }
 }
 
-mq_private* node::dispatch_message(service_monitor& svc_monitor, mq_private* q, int weight)
+mq_private* node::dispatch_message(service_monitor& svc_monitor, mq_private* q)
 {
     // peek next q from global mq
     if (q == nullptr)
@@ -151,28 +208,42 @@ mq_private* node::dispatch_message(service_monitor& svc_monitor, mq_private* q,
         return mq_global::instance()->pop();
     }
 
+    // bounded mailbox (drop oldest)
+    struct drop_t d = { svc_handle };
+    q->trim(trim_message, &d);
+
+    // dispatch budget of this turn
+    uint64_t time_slice = _time_slice();
+    uint64_t start_ns = time_helper::get_time_ns();
+    uint64_t now_ns = start_ns;
+    int budget = 1;
+    int count = 0;
+    bool is_empty = false;
+
     // handle message
     service_message msg;
-    int n = 1;
-    for (int i = 0; i < n; i++)
+    while (count < budget)
     {
         // pop a private message
-        bool is_empty = q->pop(&msg);
+        is_empty = q->pop(&msg);
 
         // service private queue is empty
         if (is_empty)
+            break;
+
+        // sojourn time overload control: shed or defer droppable messages
+        int action = q->on_dequeue(&msg, now_ns);
+        if (action != mq_codel::ACTION_DISPATCH)
         {
-            service_manager::instance()->release_service(svc_ctx);
-            return mq_global::instance()->pop();
+            if (action == mq_codel::ACTION_SHED)
+                trim_message(&msg, &d);
+            continue;
         }
 
-        // weight: -1 process one message;
-        //          0 process all messages;
-        //         >0 process 1 / (2 ^ weight) messages.
-        if (i == 0 && weight >= 0)
+        // message budget, bounded by the messages already in queue
+        if (count == 0)
         {
-            n = q->length();
-            n >>= weight;
+            budget = _message_budget(svc_ctx, q->length() + 1, time_slice);
         }
 
         // check overload, just log
@@ -183,24 +254,41 @@ mq_private* node::dispatch_message(service_monitor& svc_monitor, mq_private* q,
         }
 
         // process message
+        _process_message(svc_monitor, svc_ctx, &msg);
+        ++count;
+
+        // time slice is used up (message cost is underestimated)
+        now_ns = time_helper::get_time_ns();
+        if (now_ns - start_ns >= time_slice)
+            break;
+
+        // a call request/response has been handed off to this worker, run it first
+        if (mq_global::instance()->is_handoff_pending())
         {
-            // tell service monitor, that the service start handle messages.
-            svc_monitor.process_begin(msg.src_svc_handle , svc_handle);
-
-            if (svc_ctx->msg_callback_ == nullptr)
-            {
-                delete[] msg.data_ptr;
-            }
-            else
-            {
-                _do_dispatch_message(svc_ctx, &msg);
-            }
-
-            // tell service monitor, that the service has handle messages.
-            svc_monitor.process_end();
+            is_empty = q->try_give_up();
+            break;
         }
     }
 
+    // update average message cost
+    if (count > 0)
+    {
+        _update_message_cost(svc_ctx, (now_ns - start_ns) / count);
+    }
+
+    // cpu quota
+    if (svc_ctx->cpu_quota_ > 0)
+    {
+        _check_quota(svc_ctx, q, now_ns);
+    }
+
+    // service private queue is empty
+    if (is_empty)
+    {
+        service_manager::instance()->release_service(svc_ctx);
+        return mq_global::instance()->pop();
+    }
+
     // next private queue
     assert(q == svc_ctx->queue_);
     mq_private* next_q = mq_global::instance()->pop();
@@ -208,6 +296,8 @@ mq_private* node::dispatch_message(service_monitor& svc_monitor, mq_private* q,
     {
         // If global mq is not empty, push q back, and return next queue;
         // Else (global mq is empty or block, don't push q back, and return q again (for next dispatch).
+        // q just ran, it goes to the ring even if high lane messages are pending (runnext is for a newly woken queue),
+        // otherwise a queue always with high lane work would run every other turn.
         mq_global::instance()->push(q);
         q = next_q;
     }
@@ -217,6 +307,102 @@ mq_private* node::dispatch_message(service_monitor& svc_monitor, mq_private* q,
     return q;
 }
 
+bool node::dispatch_exclusive(service_monitor& svc_monitor, mq_private* q)
+{
+    // service handle
+    uint32_t svc_handle = q->svc_handle_;
+
+    service_context* svc_ctx = service_manager::instance()->grab(svc_handle);
+    // service context not exists, wait the queue marked release (by service context delete), then drop it
+    if (svc_ctx == nullptr)
+    {
+        while (!q->is_release_.load())
+        {
+            std::this_thread::yield();
+        }
+
+        struct drop_t d = { svc_handle };
+        q->release(drop_message, &d);
+        return false;
+    }
+
+    // handle all messages
+    struct drop_t d = { svc_handle };
+    service_message msg;
+    for (;;)
+    {
+        // bounded mailbox (drop oldest)
+        q->trim(trim_message, &d);
+
+        // service private queue is empty
+        if (q->pop(&msg))
+            break;
+
+        // sojourn time overload control: shed or defer droppable messages
+        int action = q->on_dequeue(&msg, time_helper::get_time_ns());
+        if (action != mq_codel::ACTION_DISPATCH)
+        {
+            if (action == mq_codel::ACTION_SHED)
+                trim_message(&msg, &d);
+            continue;
+        }
+
+        // check overload, just log
+        int overload = q->overload();
+        if (overload != 0)
+        {
+            log_warn(svc_ctx, fmt::format("May overload, message queue length = {}", overload));
+        }
+
+        // process message
+        _process_message(svc_monitor, svc_ctx, &msg);
+    }
+
+    service_manager::instance()->release_service(svc_ctx);
+
+    return true;
+}
+
+// the first launch argument (e.g. snlua gate)
+static std::string launch_arg0(const char* svc_args)
+{
+    if (svc_args == nullptr)
+        return std::string();
+
+    const char* end = ::strchr(svc_args, ' ');
+    return end != nullptr ? std::string(svc_args, end - svc_args) : std::string(svc_args);
+}
+
+bool node::is_exclusive(const char* svc_name, const char* svc_args)
+{
+    if (config_.exclusive_.empty())
+        return false;
+
+    std::string arg0 = launch_arg0(svc_args);
+    for (auto& name : config_.exclusive_)
+    {
+        if (name == svc_name || name == arg0)
+            return true;
+    }
+
+    return false;
+}
+
+int node::cpu_quota(const char* svc_name, const char* svc_args)
+{
+    if (config_.cpu_quota_.empty())
+        return 0;
+
+    std::string arg0 = launch_arg0(svc_args);
+    for (auto& quota : config_.cpu_quota_)
+    {
+        if (quota.first == svc_name || quota.first == arg0)
+            return quota.second;
+    }
+
+    return 0;
+}
+
 // use snlua to start lua service `bootstrap`
 void node::_bootstrap(service_context* log_svc_ctx, const char* cmdline)
 {
@@ -259,6 +445,10 @@ void node::_dispatch_all(service_context* svc_ctx)
     service_message msg;
     mq_private* q = svc_ctx->queue_;
 
+    // exclusive service (e.g. logger in config `exclusive`), its own thread is the only consumer
+    if (node_exclusive::instance()->wait_idle(q))
+        return;
+
     // dispatch all
     while (!q->pop(&msg))
     {
@@ -266,6 +456,96 @@ void node::_dispatch_all(service_context* svc_ctx)
     }
 }
 
+uint64_t node::_time_slice()
+{
+    // shrink the time slice when more queues are waiting
+    int waiting = mq_global::instance()->length();
+    uint64_t time_slice = DISPATCH_TIME_SLICE_MAX / (1 + waiting);
+
+    return time_slice > DISPATCH_TIME_SLICE_MIN ? time_slice : DISPATCH_TIME_SLICE_MIN;
+}
+
+int node::_message_budget(service_context* svc_ctx, int length, uint64_t time_slice)
+{
+    // not measured yet, the time slice limits the turn
+    uint64_t cost = svc_ctx->message_cost_.load(std::memory_order_relaxed);
+    if (cost == 0)
+        return length;
+
+    uint64_t budget = time_slice / cost;
+    if (budget < 1)
+        return 1;
+
+    return budget < (uint64_t)length ? (int)budget : length;
+}
+
+void node::_update_message_cost(service_context* svc_ctx, uint64_t cost)
+{
+    // moving average (1/8 weight of the new sample), written by the dispatching worker only
+    uint64_t message_cost = svc_ctx->message_cost_.load(std::memory_order_relaxed);
+    if (message_cost == 0)
+    {
+        message_cost = cost > 0 ? cost : 1;
+    }
+    else
+    {
+        message_cost = (message_cost * 7 + cost) / 8;
+        if (message_cost == 0)
+            message_cost = 1;
+    }
+    svc_ctx->message_cost_.store(message_cost, std::memory_order_relaxed);
+}
+
+void node::_check_quota(service_context* svc_ctx, mq_private* q, uint64_t now_ns)
+{
+    uint64_t window_ns = (uint64_t)config_.cpu_quota_window_ * 1000000;
+
+    // new window, back to normal priority
+    if (now_ns - svc_ctx->quota_start_ns_ >= window_ns)
+    {
+        svc_ctx->quota_start_ns_ = now_ns;
+        svc_ctx->quota_base_ = svc_ctx->cpu_cost_.load(std::memory_order_relaxed);
+        q->is_low_.store(false, std::memory_order_relaxed);
+        return;
+    }
+
+    if (q->is_low_.load(std::memory_order_relaxed))
+        return;
+
+    // cpu time used in this window (cpu_cost_ in microsec)
+    uint64_t used_ns = (svc_ctx->cpu_cost_.load(std::memory_order_relaxed) - svc_ctx->quota_base_) * 1000;
+    if (used_ns * 100 < window_ns * svc_ctx->cpu_quota_)
+        return;
+
+    q->is_low_.store(true, std::memory_order_relaxed);
+    ++svc_ctx->quota_throttle_count_;
+    log_warn(svc_ctx, fmt::format("Over cpu quota {}% ({} ms used), deprioritized for {} ms", svc_ctx->cpu_quota_,
+        used_ns / 1000000, (svc_ctx->quota_start_ns_ + window_ns - now_ns) / 1000000));
+}
+
+void node::_process_message(service_monitor& svc_monitor, service_context* svc_ctx, service_message* msg)
+{
+    // tell service monitor, that the service start handle messages.
+    svc_monitor.process_begin(msg->src_svc_handle , svc_ctx->svc_handle_);
+
+    if (svc_ctx->msg_callback_ == nullptr)
+    {
+        free_message(msg);
+    }
+    // call session tracking: drop the late response of an expired call, and the deadline of a finished call
+    else if (!svc_ctx->sessions_.on_dispatch(msg))
+    {
+        free_message(msg);
+    }
+    else
+    {
+        _do_dispatch_message(svc_ctx, msg);
+    }
+
+    // tell service monitor, that the service has handle messages.
+    svc_monitor.process_end();
+}
+
 // handle service message (call service message callback)
 void node::_do_dispatch_message(service_context* svc_ctx, service_message* msg)
 {
@@ -273,14 +553,27 @@ void node::_do_dispatch_message(service_context* svc_ctx, service_message* msg)
     size_t msg_sz = msg->data_size & MESSAGE_TYPE_MASK;
     if (svc_ctx->log_fd_ != nullptr)
     {
-        service_log::log(svc_ctx->log_fd_, msg->src_svc_handle, svc_msg_type, msg->session_id, msg->data_ptr, msg_sz);
+        // multicast: log the payload of the shared package
+        void* log_data = msg->data_ptr;
+        if (svc_msg_type == SERVICE_MSG_TYPE_MULTICAST && !msg->is_inline)
+            log_data = ((multicast_package*)msg->data_ptr)->data;
+        service_log::log(svc_ctx->log_fd_, msg->src_svc_handle, svc_msg_type, msg->session_id, log_data, msg_sz);
     }
 
     //
-    ++svc_ctx->message_count_;
+    svc_ctx->message_count_.fetch_add(1, std::memory_order_relaxed);
+
+    // the callback keeps the message (forward mode), the inline payload can't live longer than this dispatch, move it to heap
+    if (msg->is_inline && svc_ctx->is_forward_)
+    {
+        char* data = new char[msg_sz + 1];
+        ::memcpy(data, msg->inline_data, msg_sz + 1);
+        msg->data_ptr = data;
+        msg->is_inline = false;
+    }
 
     int reserve_msg = 0;
-    if (svc_ctx->profile_)
+    if (svc_ctx->profile_ || svc_ctx->cpu_quota_ > 0)
     {
         svc_ctx->cpu_start_ = time_helper::thread_time();
 
@@ -288,7 +581,7 @@ void node::_do_dispatch_message(service_context* svc_ctx, service_message* msg)
         reserve_msg = svc_ctx->msg_callback_(svc_ctx, svc_ctx->cb_ud_, svc_msg_type, msg->session_id, msg->src_svc_handle, msg->data_ptr, msg_sz);
 
         uint64_t cost_time = time_helper::thread_time() - svc_ctx->cpu_start_;
-        svc_ctx->cpu_cost_ += cost_time;
+        svc_ctx->cpu_cost_.fetch_add(cost_time, std::memory_order_relaxed);
     }
     else
     {
@@ -299,7 +592,7 @@ void node::_do_dispatch_message(service_context* svc_ctx, service_message* msg)
     //
     if (reserve_msg == 0)
     {
-        delete[] msg->data_ptr;
+        free_message(msg);
     }
 }
 
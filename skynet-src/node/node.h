@@ -37,6 +37,14 @@ private:
 public:
     static node* instance();
 
+private:
+    // constants
+    enum
+    {
+        DISPATCH_TIME_SLICE_MAX = 2000000,                  // max dispatch time slice of a service queue per turn (nanoseconds), when no queue waiting
+        DISPATCH_TIME_SLICE_MIN = 100000,                   // min dispatch time slice of a service queue per turn (nanoseconds), when the node is busy
+    };
+
     // node info
 private:
     node_config config_;                    // skynet node config
@@ -60,8 +68,19 @@ public:
     void enable_profiler(int enable);
     bool is_profile();
 
-    // process service message, called by work thread, return next queue
-    mq_private* dispatch_message(service_monitor& svc_monitor, mq_private*, int weight);
+    // process service message, called by work thread, return next queue.
+    // the number of messages processed per turn is adaptive: a time slice (shrinks when more queues are waiting)
+    // divided by the average message cost of the service, and bounded by the queue length.
+    // a service over its cpu quota (cpu_cost_ in the window) runs after the other queues until the window resets.
+    mq_private* dispatch_message(service_monitor& svc_monitor, mq_private* q);
+    // process all messages of an exclusive service, called by its own thread.
+    // return false if the service has been released (the queue has been dropped)
+    bool dispatch_exclusive(service_monitor& svc_monitor, mq_private* q);
+
+    // check the service should run in its own thread (config `exclusive`)
+    bool is_exclusive(const char* svc_name, const char* svc_args);
+    // cpu quota of the service class (config `cpu_quota`, percent of one worker thread), 0: unlimited
+    int cpu_quota(const char* svc_name, const char* svc_args);
 
 private:
     //
@@ -69,6 +88,17 @@ private:
     // for log output before exit
     void _dispatch_all(service_context* svc_ctx);
 
+    // dispatch time slice of current turn (nanoseconds)
+    uint64_t _time_slice();
+    // number of messages can be processed in the time slice
+    int _message_budget(service_context* svc_ctx, int length, uint64_t time_slice);
+    // update average message cost of the service (nanoseconds)
+    void _update_message_cost(service_context* svc_ctx, uint64_t cost);
+    // cpu quota: start a new window, or deprioritize the queue if the service is over quota in this window
+    void _check_quota(service_context* svc_ctx, mq_private* q, uint64_t now_ns);
+
+    // process a service message, with service monitor
+    void _process_message(service_monitor& svc_monitor, service_context* svc_ctx, service_message* msg);
     // handle service message (call service message callback)
     void _do_dispatch_message(service_context* svc_ctx, service_message* msg);
 };
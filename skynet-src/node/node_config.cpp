@@ -1,9 +1,12 @@
 #include "node_config.h"
 #include "node_env.h"
 
+#include "../utils/cpu_affinity.h"
+
 #include <iostream>
 #include <cassert>
 #include <cstring>
+#include <algorithm>
 
 extern "C" {
 #include <lua.h>
@@ -14,6 +17,31 @@ extern "C" {
 namespace skynet {
 
 
+// split a config list (separated by ',' or ' '), skip empty items
+static std::vector<std::string> _split_list(const char* str)
+{
+    std::vector<std::string> items;
+    std::string item;
+    for (const char* p = str; ; p++)
+    {
+        if (*p == ',' || *p == ' ' || *p == '\0')
+        {
+            if (!item.empty())
+                items.push_back(item);
+            item.clear();
+
+            if (*p == '\0')
+                break;
+        }
+        else
+        {
+            item.push_back(*p);
+        }
+    }
+
+    return items;
+}
+
 // initialize skynet node env (load config)
 static void _init_env(lua_State* L, std::string parent_key = "")
 {
@@ -143,10 +171,60 @@ bool node_config::load(const std::string& config_file)
 
     // read config from node env
     thread_ = skynet::node_env::instance()->get_int32("thread", 8);                                 // work thread count
+    thread_min_ = skynet::node_env::instance()->get_int32("thread_min", thread_);                   // min work thread count
+    thread_max_ = skynet::node_env::instance()->get_int32("thread_max", thread_);                   // max work thread count
     cservice_path_ = skynet::node_env::instance()->get_string("cservice_path", "./cservice/?.so");  // c service mod search path
     bootstrap_ = skynet::node_env::instance()->get_string("bootstrap","snlua bootstrap");           // bootstrap服务
     daemon_pid_file_ = skynet::node_env::instance()->get_string("daemon", nullptr);                 // enable/disable daemon mode
     profile_ = skynet::node_env::instance()->get_boolean("profile", 1);                             // enable/disable statistics
+    call_fastpath_ = skynet::node_env::instance()->get_boolean("call_fastpath", 0);                 // enable/disable call fast path
+
+    // worker scaling range, contains the initial count
+    thread_min_ = std::max(1, std::min(thread_min_, thread_));
+    thread_max_ = std::max(thread_max_, thread_);
+
+    // exclusive services (separated by ',' or ' ')
+    exclusive_ = _split_list(skynet::node_env::instance()->get_string("exclusive", ""));
+
+    // cpu quota (name:percent, separated by ',' or ' ')
+    for (auto& item : _split_list(skynet::node_env::instance()->get_string("cpu_quota", "")))
+    {
+        size_t pos = item.find(':');
+        int percent = pos != std::string::npos ? ::atoi(item.c_str() + pos + 1) : 0;
+        if (pos == 0 || percent <= 0)
+        {
+            std::cerr << "invalid cpu quota: " << item << std::endl;
+            return false;
+        }
+        cpu_quota_.emplace_back(item.substr(0, pos), percent);
+    }
+    cpu_quota_window_ = std::max(10, skynet::node_env::instance()->get_int32("cpu_quota_window", 1000));
+
+    // record & replay
+    record_file_ = skynet::node_env::instance()->get_string("record", nullptr);
+    replay_file_ = skynet::node_env::instance()->get_string("replay", nullptr);
+    replay_speed_ = ::atof(skynet::node_env::instance()->get_string("replay_speed", "0"));
+
+    // cpu affinity
+    struct
+    {
+        const char* key;
+        std::vector<int>* cpus;
+    } affinity[] = {
+        { "affinity_worker", &affinity_worker_ },
+        { "affinity_socket", &affinity_socket_ },
+        { "affinity_timer", &affinity_timer_ },
+        { "affinity_monitor", &affinity_monitor_ },
+    };
+    for (auto& a : affinity)
+    {
+        const char* cpu_list = skynet::node_env::instance()->get_string(a.key, "");
+        if (!cpu_affinity::parse(cpu_list, *a.cpus))
+        {
+            std::cerr << "invalid cpu list: " << a.key << " = " << cpu_list << std::endl;
+            return false;
+        }
+    }
 
     return true;
 }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace skynet {
 
@@ -9,8 +10,11 @@ class node_config final
 {
     // base info
 public:
-    int thread_;                        // worker thread count (不要配置超过实际拥有的CPU核心数)
+    int thread_;                        // worker thread count (不要配置超过实际拥有的CPU核心数), the initial count if scaling
+    int thread_min_;                    // min worker thread count (dynamic scaling), default: thread
+    int thread_max_;                    // max worker thread count (dynamic scaling), default: thread
     int profile_;                       // enable/disable statistics (cpu cost each service), default enable
+    int call_fastpath_;                 // enable/disable call fast path (call request/response runs on the sending worker next), default disable
 
     const char* daemon_pid_file_;       // daemon pid file, enable/disable daemon mode
                                         // - enable:  daemon = "./skynet.pid"
@@ -22,6 +26,25 @@ public:
     const char* cservice_path_;         // C service module search path (.so search path)
     const char* bootstrap_;             // skynet 启动的第一个服务以及其启动参数。默认配置为 snlua bootstrap ，即启动一个名为 bootstrap 的 lua 服务。通常指的是 service/bootstrap.lua 这段代码。
 
+    std::vector<std::string> exclusive_;// services run in their own thread, not in the worker thread pool.
+                                        // config: exclusive = "logger,gate", match C service name or the first launch argument (snlua script name)
+
+    // cpu quota (see node::dispatch_message)
+    std::vector<std::pair<std::string, int>> cpu_quota_;    // cpu share (percent of one worker thread) by service class, over quota services are deprioritized
+                                        // config: cpu_quota = "agent:20,gate:50", match C service name or the first launch argument
+    int cpu_quota_window_;              // quota window (milliseconds), config: cpu_quota_window = 1000
+
+    // record & replay the external inputs (see node_record)
+    const char* record_file_;           // record file, config: record = "./node.rec"
+    const char* replay_file_;           // replay file, config: replay = "./node.rec"
+    double replay_speed_;               // replay pacing, 0: as fast as possible (default), 1: original pacing, n: n times faster
+
+    // cpu affinity (linux only), cpu list format: "0-3,8,10-11", empty: no affinity
+    std::vector<int> affinity_worker_;  // worker threads, worker i is pinned to the (i % n)th cpu of the list. config: affinity_worker = "0-7"
+    std::vector<int> affinity_socket_;  // socket thread. config: affinity_socket = "8"
+    std::vector<int> affinity_timer_;   // timer thread. config: affinity_timer = "9"
+    std::vector<int> affinity_monitor_; // monitor thread. config: affinity_monitor = "9"
+
 public:
     // load config
     bool load(const std::string& config_file);
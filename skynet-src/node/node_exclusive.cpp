@@ -0,0 +1,143 @@
+#include "node_exclusive.h"
+#include "node.h"
+
+#include "../mq/mq_private.h"
+
+#include "../service/service_monitor.h"
+
+#include <chrono>
+
+namespace skynet {
+
+node_exclusive* node_exclusive::instance_ = nullptr;
+
+node_exclusive* node_exclusive::instance()
+{
+    static std::once_flag oc;
+    std::call_once(oc, [&](){ instance_ = new node_exclusive; });
+
+    return instance_;
+}
+
+void node_exclusive::start(mq_private* q)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    _clean_exited();
+
+    auto t = std::make_shared<exclusive_thread>();
+    t->queue = q;
+    t->svc_monitor = std::make_shared<service_monitor>();
+
+    // the caller owns the queue now, it can't be scheduled before the thread start
+    q->set_exclusive(&node_exclusive::_wakeup, t.get());
+    t->thread = std::thread(&node_exclusive::_thread_proc, t.get());
+
+    threads_.push_back(t);
+}
+
+void node_exclusive::check()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    for (auto& t : threads_)
+    {
+        t->svc_monitor->check();
+    }
+}
+
+void node_exclusive::fini()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    // the threads exit after their services released
+    for (auto& t : threads_)
+    {
+        t->thread.join();
+    }
+    threads_.clear();
+}
+
+bool node_exclusive::wait_idle(mq_private* q)
+{
+    std::shared_ptr<exclusive_thread> t;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto& it : threads_)
+        {
+            if (it->queue == q)
+            {
+                t = it;
+                break;
+            }
+        }
+    }
+    if (t == nullptr)
+        return false;
+
+    // idle and not signaled: every message pushed before has been dispatched
+    for (;;)
+    {
+        {
+            std::lock_guard<std::mutex> lock(t->mutex);
+            if ((t->is_idle && !t->is_signaled) || t->is_exit)
+                break;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    return true;
+}
+
+void node_exclusive::_thread_proc(exclusive_thread* t)
+{
+    // the thread owns the queue at start
+    while (node::instance()->dispatch_exclusive(*t->svc_monitor, t->queue))
+    {
+        // queue is empty (ownership released), wait next message
+        std::unique_lock<std::mutex> lock(t->mutex);
+        t->is_idle = true;
+        t->cond.wait(lock, [t] { return t->is_signaled; });
+        t->is_signaled = false;
+        t->is_idle = false;
+    }
+
+    std::lock_guard<std::mutex> lock(t->mutex);
+    t->is_exit = true;
+}
+
+void node_exclusive::_wakeup(void* ud)
+{
+    exclusive_thread* t = (exclusive_thread*)ud;
+
+    std::lock_guard<std::mutex> lock(t->mutex);
+    t->is_signaled = true;
+    t->cond.notify_one();
+}
+
+void node_exclusive::_clean_exited()
+{
+    for (auto iter = threads_.begin(); iter != threads_.end();)
+    {
+        auto& t = *iter;
+
+        bool is_exit = false;
+        {
+            std::lock_guard<std::mutex> lock(t->mutex);
+            is_exit = t->is_exit;
+        }
+
+        if (is_exit)
+        {
+            t->thread.join();
+            iter = threads_.erase(iter);
+        }
+        else
+        {
+            ++iter;
+        }
+    }
+}
+
+}
+
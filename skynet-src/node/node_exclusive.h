@@ -0,0 +1,68 @@
+#pragma once
+
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace skynet {
+
+// forward declare
+class mq_private;
+class service_monitor;
+
+/**
+ * exclusive service thread manager
+ *
+ * an exclusive service has its own thread and wakeup, the thread drains the service private queue directly,
+ * never goes through global mq, so it will not wait behind other services in the worker thread pool.
+ */
+class node_exclusive final
+{
+private:
+    static node_exclusive* instance_;
+public:
+    static node_exclusive* instance();
+
+private:
+    // exclusive service thread data
+    struct exclusive_thread
+    {
+        mq_private* queue = nullptr;                        // service private queue
+        std::shared_ptr<service_monitor> svc_monitor;       // dead loop/blocked monitor
+
+        std::thread thread;                                 //
+        std::mutex mutex;                                   //
+        std::condition_variable cond;                       //
+        bool is_signaled = false;                           // queue has been scheduled (new message arrived)
+        bool is_idle = false;                               // thread waits next message (queue drained)
+        bool is_exit = false;                               // thread exit (the service has been released)
+    };
+
+private:
+    std::mutex mutex_;                                      // protect threads_
+    std::list<std::shared_ptr<exclusive_thread>> threads_;  //
+
+public:
+    // start the exclusive thread for a service private queue (the queue must be owned by caller)
+    void start(mq_private* q);
+    // check exclusive threads (dead loop or blocked), call in monitor thread
+    void check();
+    // wait all exclusive threads exit
+    void fini();
+    // wait the exclusive thread of a queue drains it, return false if the queue is not exclusive
+    bool wait_idle(mq_private* q);
+
+private:
+    // exclusive thread proc
+    static void _thread_proc(exclusive_thread* t);
+    // queue wakeup proc
+    static void _wakeup(void* ud);
+
+    // join the threads whose service has been released
+    void _clean_exited();
+};
+
+}
+
@@ -0,0 +1,460 @@
+#include "node_record.h"
+#include "node_config.h"
+#include "node_socket.h"
+
+#include "../log/log.h"
+
+#include "../mq/mq_msg.h"
+#include "../mq/mq_private.h"
+#include "../socket/socket_server_def.h"
+#include "../service/service_context.h"
+#include "../service/service_manager.h"
+
+#include "../utils/time_helper.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <iostream>
+#include <chrono>
+
+namespace skynet {
+
+// file magic
+static const char RECORD_MAGIC[8] = { 'S', 'K', 'Y', 'N', 'E', 'T', 'R', 'C' };
+
+node_record* node_record::instance_ = nullptr;
+
+node_record* node_record::instance()
+{
+    static std::once_flag oc;
+    std::call_once(oc, [&](){ instance_ = new node_record; });
+
+    return instance_;
+}
+
+bool node_record::init(const node_config& config)
+{
+    if (config.record_file_ != nullptr && config.replay_file_ != nullptr)
+    {
+        std::cerr << "record and replay can't be enabled at the same time" << std::endl;
+        return false;
+    }
+
+    // record
+    if (config.record_file_ != nullptr)
+    {
+        file_ = ::fopen(config.record_file_, "wb");
+        if (file_ == nullptr)
+        {
+            std::cerr << "open record file failed: " << config.record_file_ << std::endl;
+            return false;
+        }
+        file_buffer_ = new char[FILE_BUFFER_SIZE];
+        ::setvbuf(file_, file_buffer_, _IOFBF, FILE_BUFFER_SIZE);
+
+        uint8_t version[4] = { FILE_VERSION, 0, 0, 0 };
+        ::fwrite(RECORD_MAGIC, sizeof(RECORD_MAGIC), 1, file_);
+        ::fwrite(version, sizeof(version), 1, file_);
+
+        last_ns_ = time_helper::get_time_ns();
+        flush_ns_ = last_ns_;
+        mode_ = MODE_RECORD;
+        return true;
+    }
+
+    // replay
+    if (config.replay_file_ != nullptr)
+    {
+        file_ = ::fopen(config.replay_file_, "rb");
+        if (file_ == nullptr)
+        {
+            std::cerr << "open replay file failed: " << config.replay_file_ << std::endl;
+            return false;
+        }
+        file_buffer_ = new char[FILE_BUFFER_SIZE];
+        ::setvbuf(file_, file_buffer_, _IOFBF, FILE_BUFFER_SIZE);
+
+        // file size
+        long file_size = -1;
+        if (::fseek(file_, 0, SEEK_END) == 0)
+            file_size = ::ftell(file_);
+        if (file_size < 0 || ::fseek(file_, 0, SEEK_SET) != 0)
+        {
+            std::cerr << "seek replay file failed: " << config.replay_file_ << std::endl;
+            return false;
+        }
+        file_size_ = (uint64_t)file_size;
+
+        // header
+        char magic[sizeof(RECORD_MAGIC)] = { 0 };
+        uint8_t version[4] = { 0 };
+        if (::fread(magic, sizeof(magic), 1, file_) != 1 || ::memcmp(magic, RECORD_MAGIC, sizeof(magic)) != 0 ||
+            ::fread(version, sizeof(version), 1, file_) != 1 || version[0] != FILE_VERSION)
+        {
+            std::cerr << "invalid replay file: " << config.replay_file_ << std::endl;
+            return false;
+        }
+
+        // the first event is bootstrap
+        uint64_t delta_ns = 0;
+        uint64_t svc_handle = 0;
+        if (::fgetc(file_) != EVENT_BOOTSTRAP || !_get_varint(delta_ns) || !_get_varint(svc_handle) || !_get_bytes(bootstrap_))
+        {
+            std::cerr << "invalid replay file (no bootstrap): " << config.replay_file_ << std::endl;
+            return false;
+        }
+
+        replay_speed_ = config.replay_speed_;
+        mode_ = MODE_REPLAY;
+        return true;
+    }
+
+    return true;
+}
+
+void node_record::fini()
+{
+    if (replay_thread_.joinable())
+    {
+        is_replay_quit_.store(true);
+        replay_thread_.join();
+    }
+
+    if (file_ != nullptr)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+
+        if (mode_ == MODE_RECORD)
+        {
+            log_info(nullptr, fmt::format("Record finished, {} events", event_count_));
+        }
+
+        ::fclose(file_);
+        file_ = nullptr;
+        delete[] file_buffer_;
+        file_buffer_ = nullptr;
+    }
+
+    mode_ = MODE_OFF;
+}
+
+void node_record::record_bootstrap(const char* cmdline)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    event_buf_.clear();
+    size_t sz = ::strlen(cmdline);
+    _put_varint(event_buf_, sz);
+    event_buf_.append(cmdline, sz);
+    _write_event(EVENT_BOOTSTRAP, 0);
+}
+
+void node_record::record_timer(uint32_t svc_handle, int session_id)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    event_buf_.clear();
+    _put_zigzag(event_buf_, session_id);
+    _write_event(EVENT_TIMER, svc_handle);
+}
+
+void node_record::record_socket(int socket_event, socket_message* msg, const char* payload, size_t payload_sz)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    event_buf_.clear();
+    event_buf_.push_back((char)socket_event);
+    _put_zigzag(event_buf_, msg->socket_id);
+    _put_zigzag(event_buf_, msg->ud);
+    _put_varint(event_buf_, payload_sz);
+    if (payload_sz > 0)
+    {
+        event_buf_.append(payload, payload_sz);
+    }
+    _write_event(EVENT_SOCKET, msg->svc_handle);
+}
+
+void node_record::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    if (file_ == nullptr || !is_dirty_)
+        return;
+
+    uint64_t now_ns = time_helper::get_time_ns();
+    if (now_ns - flush_ns_ < (uint64_t)FLUSH_INTERVAL * 1000000)
+        return;
+
+    ::fflush(file_);
+    flush_ns_ = now_ns;
+    is_dirty_ = false;
+}
+
+const char* node_record::replay_bootstrap()
+{
+    return bootstrap_.c_str();
+}
+
+void node_record::start_replay()
+{
+    replay_thread_ = std::thread(&node_record::_replay_proc, this);
+}
+
+bool node_record::replay_timeout(uint32_t svc_handle, int session_id)
+{
+    uint64_t key = ((uint64_t)svc_handle << 32) | (uint32_t)session_id;
+
+    std::lock_guard<std::mutex> lock(timer_mutex_);
+
+    if (timer_expired_.erase(key) > 0)
+        return true;
+
+    timer_pending_.insert(key);
+    return false;
+}
+
+void node_record::_replay_proc()
+{
+    uint64_t start_ns = time_helper::get_time_ns();
+    uint64_t record_ns = 0;
+
+    for (;;)
+    {
+        if (is_replay_quit_.load() || service_manager::instance()->svc_count() == 0)
+            break;
+
+        int type = ::fgetc(file_);
+        uint64_t delta_ns = 0;
+        if (type == EOF || !_get_varint(delta_ns))
+            break;
+        record_ns += delta_ns;
+
+        // original pacing
+        if (replay_speed_ > 0)
+        {
+            uint64_t due_ns = start_ns + (uint64_t)(record_ns / replay_speed_);
+            for (;;)
+            {
+                uint64_t now_ns = time_helper::get_time_ns();
+                if (now_ns >= due_ns || is_replay_quit_.load())
+                    break;
+
+                uint64_t wait_ms = (due_ns - now_ns) / 1000000;
+                if (wait_ms == 0)
+                {
+                    std::this_thread::yield();
+                    continue;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(wait_ms < REPLAY_SLEEP_MAX ? wait_ms : REPLAY_SLEEP_MAX));
+            }
+        }
+
+        if (!_replay_event(type))
+        {
+            log_error(nullptr, fmt::format("Replay file is corrupted, after {} events", event_count_));
+            return;
+        }
+        ++event_count_;
+    }
+
+    double elapsed = (double)(time_helper::get_time_ns() - start_ns) / 1000000000.0;
+    log_info(nullptr, fmt::format("Replay finished, {} events in {:.3f}s (recorded {:.3f}s)", event_count_, elapsed, (double)record_ns / 1000000000.0));
+}
+
+bool node_record::_replay_event(int type)
+{
+    uint64_t svc_handle = 0;
+    if (!_get_varint(svc_handle))
+        return false;
+
+    // timer expiration
+    if (type == EVENT_TIMER)
+    {
+        int64_t session_id = 0;
+        if (!_get_zigzag(session_id))
+            return false;
+
+        if (_wait_service((uint32_t)svc_handle))
+        {
+            _expire_timer((uint32_t)svc_handle, (int)session_id);
+        }
+
+        return true;
+    }
+
+    // socket event
+    if (type == EVENT_SOCKET)
+    {
+        int socket_event = ::fgetc(file_);
+        int64_t socket_id = 0;
+        int64_t ud = 0;
+        std::string payload;
+        if (socket_event == EOF || !_get_zigzag(socket_id) || !_get_zigzag(ud) || !_get_bytes(payload))
+            return false;
+
+        if (!_wait_service((uint32_t)svc_handle))
+            return true;
+
+        socket_message msg;
+        msg.socket_id = (int)socket_id;
+        msg.svc_handle = (uint32_t)svc_handle;
+        msg.ud = (int)ud;
+        msg.data_ptr = nullptr;
+        if (socket_event == SKYNET_SOCKET_EVENT_DATA || socket_event == SKYNET_SOCKET_EVENT_UDP)
+        {
+            // the receiver owns the data
+            msg.data_ptr = new char[payload.size()];
+            ::memcpy(msg.data_ptr, payload.data(), payload.size());
+        }
+        else if (!payload.empty())
+        {
+            // padding string, copied by node_socket
+            msg.data_ptr = const_cast<char*>(payload.c_str());
+        }
+        node_socket::instance()->replay_event(socket_event, &msg);
+
+        return true;
+    }
+
+    // bootstrap is only the first event
+    return false;
+}
+
+bool node_record::_wait_service(uint32_t svc_handle)
+{
+    if (missing_services_.find(svc_handle) != missing_services_.end())
+        return false;
+
+    bool is_exists = false;
+    uint64_t deadline_ns = time_helper::get_time_ns() + (uint64_t)REPLAY_WAIT_MAX * 1000000;
+    while (!is_replay_quit_.load())
+    {
+        service_context* svc_ctx = service_manager::instance()->grab(svc_handle);
+        if (svc_ctx != nullptr)
+        {
+            // initialized and has consumed the previous inputs (so the service has made the requests this input answers)
+            is_exists = true;
+            bool is_ready = svc_ctx->is_init_ && svc_ctx->queue_->length() == 0;
+            service_manager::instance()->release_service(svc_ctx);
+            if (is_ready)
+                return true;
+        }
+
+        if (time_helper::get_time_ns() >= deadline_ns)
+            break;
+
+        std::this_thread::yield();
+    }
+
+    // busy, feed it anyway
+    if (is_exists)
+        return true;
+
+    // the recorded service is not created in replay (or has exited), drop its events
+    log_warn(nullptr, fmt::format("Replay: service :{:08x} not exists, drop its events", svc_handle));
+    missing_services_.insert(svc_handle);
+
+    return false;
+}
+
+void node_record::_expire_timer(uint32_t svc_handle, int session_id)
+{
+    uint64_t key = ((uint64_t)svc_handle << 32) | (uint32_t)session_id;
+
+    {
+        std::lock_guard<std::mutex> lock(timer_mutex_);
+
+        // not started yet, expire when it is started
+        if (timer_pending_.erase(key) == 0)
+        {
+            timer_expired_.insert(key);
+            return;
+        }
+    }
+
+    service_message msg;
+    msg.src_svc_handle = 0;
+    msg.session_id = session_id;
+    msg.data_ptr = nullptr;
+    msg.data_size = (size_t)SERVICE_MSG_TYPE_RESPONSE << MESSAGE_TYPE_SHIFT;
+    service_manager::instance()->push_service_message(svc_handle, &msg);
+}
+
+void node_record::_write_event(int type, uint32_t svc_handle)
+{
+    if (file_ == nullptr)
+        return;
+
+    uint64_t now_ns = time_helper::get_time_ns();
+    uint64_t delta_ns = now_ns > last_ns_ ? now_ns - last_ns_ : 0;
+    last_ns_ += delta_ns;
+
+    std::string head;
+    head.push_back((char)type);
+    _put_varint(head, delta_ns);
+    _put_varint(head, svc_handle);
+
+    ::fwrite(head.data(), head.size(), 1, file_);
+    ::fwrite(event_buf_.data(), event_buf_.size(), 1, file_);
+    ++event_count_;
+    is_dirty_ = true;
+}
+
+void node_record::_put_varint(std::string& buf, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        buf.push_back((char)(value | 0x80));
+        value >>= 7;
+    }
+    buf.push_back((char)value);
+}
+
+void node_record::_put_zigzag(std::string& buf, int64_t value)
+{
+    _put_varint(buf, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63));
+}
+
+bool node_record::_get_varint(uint64_t& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int c = ::fgetc(file_);
+        if (c == EOF)
+            return false;
+
+        value |= (uint64_t)(c & 0x7f) << shift;
+        if ((c & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+bool node_record::_get_zigzag(int64_t& value)
+{
+    uint64_t v = 0;
+    if (!_get_varint(v))
+        return false;
+
+    value = (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    return true;
+}
+
+bool node_record::_get_bytes(std::string& bytes)
+{
+    uint64_t sz = 0;
+    if (!_get_varint(sz))
+        return false;
+
+    // a corrupted length can't exceed the rest of the file
+    long pos = ::ftell(file_);
+    if (pos < 0 || sz > file_size_ - (uint64_t)pos)
+        return false;
+
+    bytes.resize(sz);
+    return sz == 0 || ::fread(&bytes[0], sz, 1, file_) == 1;
+}
+
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <unordered_set>
+
+namespace skynet {
+
+// forward declare
+class node_config;
+struct socket_message;
+
+/**
+ * record & replay the external inputs of the node (for offline performance testing)
+ *
+ * record (config: record = "./node.rec"):
+ * the ordered stream of external inputs is written to a binary file with timestamps:
+ * bootstrap command line, timer expirations, socket events (from node_socket::poll_socket_event).
+ *
+ * replay (config: replay = "./node.rec", replay_speed = 0):
+ * the node boots with the recorded bootstrap, and a replay thread feeds the recorded timer expirations and socket events
+ * back to the services. replay_speed: 0, as fast as possible (an event is fed once its service has consumed the previous ones);
+ * 1, the original pacing; n, n times faster.
+ * the replay follows the recorded service handles and sessions, so the bootstrap and service startup should be deterministic.
+ * the recorded inputs replace the live ones: live socket events are dropped, live timers expire by the recorded expirations.
+ * causality is kept: an event waits for its service to be created and idle (bounded by REPLAY_WAIT_MAX),
+ * a timer never expires before the service starts it.
+ *
+ * file format: "SKYNETRC" + version (4 bytes, little endian), then events:
+ * type (1 byte), time delta (ns, varint), service handle (varint), and by type:
+ * - bootstrap: command line (varint length + bytes)
+ * - timer: session (zigzag varint)
+ * - socket: socket event (1 byte), socket id, ud (zigzag varint), payload (varint length + bytes)
+ */
+class node_record final
+{
+private:
+    static node_record* instance_;
+public:
+    static node_record* instance();
+
+private:
+    // constants
+    enum
+    {
+        FILE_VERSION = 1,                                   //
+        FILE_BUFFER_SIZE = 1024 * 1024,                     // stdio buffer size
+        REPLAY_SLEEP_MAX = 10,                              // max sleep per step when pacing (milliseconds), check quit
+        FLUSH_INTERVAL = 100,                               // record file flush interval (milliseconds)
+        REPLAY_WAIT_MAX = 1000,                             // max wait for the service of an event to be created and idle (milliseconds)
+    };
+
+public:
+    // event types
+    enum event_type
+    {
+        EVENT_BOOTSTRAP = 1,                                //
+        EVENT_TIMER = 2,                                    // timer expiration
+        EVENT_SOCKET = 3,                                   // socket event
+    };
+
+    // modes
+    enum mode
+    {
+        MODE_OFF = 0,                                       //
+        MODE_RECORD = 1,                                    //
+        MODE_REPLAY = 2,                                    //
+    };
+
+private:
+    int mode_ = MODE_OFF;                                   // set before the threads start
+    FILE* file_ = nullptr;                                  //
+    char* file_buffer_ = nullptr;                           // stdio buffer
+    uint64_t file_size_ = 0;                                // replay file size, bound the length read from the file
+
+    // record
+    std::mutex mutex_;                                      // protect the writer
+    std::string event_buf_;                                 // event encode buffer
+    uint64_t last_ns_ = 0;                                  // time of the last event
+    uint64_t flush_ns_ = 0;                                 // time of the last flush
+    bool is_dirty_ = false;                                 // has events not flushed
+    uint64_t event_count_ = 0;                              // number of events recorded/replayed
+
+    // replay
+    double replay_speed_ = 0;                               // 0: as fast as possible, 1: original pacing
+    std::string bootstrap_;                                 // recorded bootstrap command line
+    std::thread replay_thread_;                             //
+    std::atomic<bool> is_replay_quit_ { false };            //
+    std::unordered_set<uint32_t> missing_services_;         // services never created (replay thread only)
+
+    // replay timers, key: service handle << 32 | session
+    std::mutex timer_mutex_;                                //
+    std::unordered_set<uint64_t> timer_pending_;            // started by services, not expired
+    std::unordered_set<uint64_t> timer_expired_;            // expiration replayed, not started by services yet
+
+public:
+    // open the record/replay file by config
+    bool init(const node_config& config);
+    // stop replay, close the file
+    void fini();
+
+    bool is_recording();
+    bool is_replaying();
+
+public:
+    // record: bootstrap command line
+    void record_bootstrap(const char* cmdline);
+    // record: timer expiration
+    void record_timer(uint32_t svc_handle, int session_id);
+    // record: socket event (skynet_socket_event), payload: padding string or received data
+    void record_socket(int socket_event, socket_message* msg, const char* payload, size_t payload_sz);
+    // record: flush the file once a while (called by timer thread), keep the record if the node is killed
+    void flush();
+
+    // replay: the recorded bootstrap command line
+    const char* replay_bootstrap();
+    // replay: start the replay thread
+    void start_replay();
+    // replay: a service starts a timer, return true if its expiration has been replayed (expire now),
+    // otherwise it expires when the replay reaches its expiration.
+    bool replay_timeout(uint32_t svc_handle, int session_id);
+
+private:
+    // replay thread proc
+    void _replay_proc();
+    // read an event (after the type) and feed it, return false if the file ends
+    bool _replay_event(int type);
+    // wait the service to be created and idle, return false if it's never created
+    bool _wait_service(uint32_t svc_handle);
+    // timer expiration
+    void _expire_timer(uint32_t svc_handle, int session_id);
+    // write the event buffer (lock by caller)
+    void _write_event(int type, uint32_t svc_handle);
+
+    // varint helpers
+    static void _put_varint(std::string& buf, uint64_t value);
+    static void _put_zigzag(std::string& buf, int64_t value);
+    bool _get_varint(uint64_t& value);
+    bool _get_zigzag(int64_t& value);
+    bool _get_bytes(std::string& bytes);
+};
+
+}
+
+#include "node_record.inl"
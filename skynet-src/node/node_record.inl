@@ -0,0 +1,13 @@
+namespace skynet {
+
+inline bool node_record::is_recording()
+{
+    return mode_ == MODE_RECORD;
+}
+
+inline bool node_record::is_replaying()
+{
+    return mode_ == MODE_REPLAY;
+}
+
+}
@@ -1,4 +1,5 @@
 #include "node_socket.h"
+#include "node_record.h"
 
 #include "../log/log.h"
 
@@ -73,7 +74,10 @@ static void forward_message(int socket_event, bool padding, socket_message* msg)
         }
     }
 
-    auto sm = (skynet_socket_message*)new char[sz];
+    // small message, build it in the service message (inline payload)
+    service_message svc_msg;
+    bool is_inline = sz < MESSAGE_INLINE_SIZE;
+    auto sm = is_inline ? (skynet_socket_message*)svc_msg.inline_data : (skynet_socket_message*)new char[sz];
     sm->socket_event = socket_event;
     sm->socket_id = msg->socket_id;
     sm->ud = msg->ud;
@@ -87,18 +91,21 @@ static void forward_message(int socket_event, bool padding, socket_message* msg)
         sm->buffer = msg->data_ptr;
     }
 
-    service_message svc_msg;
     svc_msg.src_svc_handle = 0;
     svc_msg.session_id = 0;
-    svc_msg.data_ptr = sm;
+    svc_msg.data_ptr = is_inline ? nullptr : sm;
     svc_msg.data_size = sz | ((size_t)SERVICE_MSG_TYPE_SOCKET << MESSAGE_TYPE_SHIFT);
+    svc_msg.is_inline = is_inline;
 
     if (service_manager::instance()->push_service_message((uint32_t)msg->svc_handle, &svc_msg))
     {
         // todo: report somewhere to close socket
         // don't call skynet_socket_close here (It will block mainloop)
         delete[] sm->buffer;
-        delete[] sm;
+        if (!is_inline)
+        {
+            delete[] sm;
+        }
     }
 }
 
@@ -112,36 +119,58 @@ int node_socket::poll_socket_event()
     socket_message msg;
     bool is_more = true;
     int type = socket_server_->poll_socket_event(&msg, is_more);
+    int socket_event = 0;
+    bool padding = false;
     switch (type)
     {
     case SOCKET_EVENT_EXIT:
         return 0;
     case SOCKET_EVENT_DATA:
-        forward_message(SKYNET_SOCKET_EVENT_DATA, false, &msg);
+        socket_event = SKYNET_SOCKET_EVENT_DATA;
         break;
     case SOCKET_EVENT_CLOSE:
-        forward_message(SKYNET_SOCKET_EVENT_CLOSE, false, &msg);
+        socket_event = SKYNET_SOCKET_EVENT_CLOSE;
         break;
     case SOCKET_EVENT_OPEN:
-        forward_message(SKYNET_SOCKET_EVENT_CONNECT, true, &msg);
+        socket_event = SKYNET_SOCKET_EVENT_CONNECT;
+        padding = true;
         break;
     case SOCKET_EVENT_ERROR:
-        forward_message(SKYNET_SOCKET_EVENT_ERROR, true, &msg);
+        socket_event = SKYNET_SOCKET_EVENT_ERROR;
+        padding = true;
         break;
     case SOCKET_EVENT_ACCEPT:
-        forward_message(SKYNET_SOCKET_EVENT_ACCEPT, true, &msg);
+        socket_event = SKYNET_SOCKET_EVENT_ACCEPT;
+        padding = true;
         break;
     case SOCKET_EVENT_UDP:
-        forward_message(SKYNET_SOCKET_EVENT_UDP, false, &msg);
+        socket_event = SKYNET_SOCKET_EVENT_UDP;
         break;
     case SOCKET_EVENT_WARNING:
-        forward_message(SKYNET_SOCKET_EVENT_WARNING, false, &msg);
+        socket_event = SKYNET_SOCKET_EVENT_WARNING;
         break;
     default:
         log_error(nullptr, fmt::format("Unknown socket message type {}.", type));
         return -1;
     }
 
+    // record the input
+    if (node_record::instance()->is_recording())
+    {
+        _record_event(socket_event, padding, &msg);
+    }
+
+    // replay: the socket inputs come from the record, drop the live ones (the recorded sockets don't exist in socket server)
+    if (node_record::instance()->is_replaying())
+    {
+        if (!padding)
+            delete[] msg.data_ptr;
+    }
+    else
+    {
+        forward_message(socket_event, padding, &msg);
+    }
+
     // more event, continue processing
     if (is_more)
         return -1;
@@ -149,6 +178,45 @@ int node_socket::poll_socket_event()
     return 1;
 }
 
+void node_socket::replay_event(int socket_event, socket_message* msg)
+{
+    bool padding = socket_event == SKYNET_SOCKET_EVENT_CONNECT || socket_event == SKYNET_SOCKET_EVENT_ERROR ||
+        socket_event == SKYNET_SOCKET_EVENT_ACCEPT;
+    forward_message(socket_event, padding, msg);
+}
+
+void node_socket::_record_event(int socket_event, bool padding, socket_message* msg)
+{
+    const char* payload = nullptr;
+    size_t payload_sz = 0;
+    if (padding)
+    {
+        // the string copied by forward_message
+        if (msg->data_ptr != nullptr)
+        {
+            payload = msg->data_ptr;
+            payload_sz = ::strlen(msg->data_ptr);
+            if (payload_sz > 128)
+                payload_sz = 128;
+        }
+    }
+    else if (socket_event == SKYNET_SOCKET_EVENT_DATA)
+    {
+        payload = msg->data_ptr;
+        payload_sz = msg->ud;
+    }
+    else if (socket_event == SKYNET_SOCKET_EVENT_UDP)
+    {
+        // data and the udp address appended
+        int addr_sz = 0;
+        socket_server_->udp_address(msg, &addr_sz);
+        payload = msg->data_ptr;
+        payload_sz = msg->ud + addr_sz;
+    }
+
+    node_record::instance()->record_socket(socket_event, msg, payload, payload_sz);
+}
+
 int node_socket::send(uint32_t svc_handle, send_data* sd_ptr)
 {
     return socket_server_->send(sd_ptr);
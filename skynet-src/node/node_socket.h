@@ -34,6 +34,7 @@ struct skynet_socket_message
 
 // forward declare
 class socket_server;
+struct socket_message;
 
 // skynet node socket
 class node_socket final
@@ -58,6 +59,8 @@ public:
 
     // poll socket event
     int poll_socket_event();
+    // replay a recorded socket event (see node_record)
+    void replay_event(int socket_event, socket_message* msg);
 
     int listen(uint32_t svc_handle, const char* local_ip, int local_port, int backlog);
     int connect(uint32_t svc_handle, const char* remote_addr, int remote_port);
@@ -78,6 +81,10 @@ public:
     const char* udp_address(skynet_socket_message*, int* addrsz);
 
     void get_socket_info(std::list<socket_info>& si_list);
+
+private:
+    // record a socket event (see node_record)
+    void _record_event(int socket_event, bool padding, socket_message* msg);
 };
 
 }
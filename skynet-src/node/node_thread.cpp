@@ -1,9 +1,13 @@
 #include "node_thread.h"
 #include "node.h"
 #include "node_socket.h"
+#include "node_exclusive.h"
+#include "node_config.h"
+#include "node_record.h"
 
 #include "../mq/mq_msg.h"
 #include "../mq/mq_private.h"
+#include "../mq/mq_global.h"
 
 #include "../timer/timer_manager.h"
 
@@ -11,13 +15,19 @@
 #include "../service/service_monitor.h"
 #include "../service/service_manager.h"
 
+#include "../log/log.h"
+
 #include "../utils/signal_helper.h"
+#include "../utils/parker.h"
+#include "../utils/cpu_affinity.h"
+#include "../utils/epoch.h"
 
 #include <iostream>
 #include <thread>
 #include <csignal>
 #include <mutex>
-#include <condition_variable>
+#include <vector>
+#include <algorithm>
 
 namespace skynet {
 
@@ -27,14 +37,48 @@ struct monitor_data
     int work_thread_num = 0;                            // number of work thread
     std::shared_ptr<service_monitor> svc_monitors;      // service work thread monitor array
 
-    int work_thread_sleep_count = 0;                    // number of sleep worker threads
-    bool is_work_thread_quit = false;                   // work thread quit flag
+    std::atomic<bool> is_work_thread_quit { false };    // work thread quit flag
+
+    // worker thread parking
+    std::shared_ptr<parker> parkers;                    // worker thread parker array
+    std::mutex idle_mutex;                              // protect idle_workers
+    std::vector<int> idle_workers;                      // parked worker threads (stack, the last parked is waked first)
+    std::atomic<int> idle_count { 0 };                  // number of parked worker threads
+    std::atomic<int> spinning_count { 0 };              // number of spinning worker threads
+
+    // worker scaling (workers [active_num, work_thread_num) are retired)
+    int work_thread_min = 0;                            // min active workers (automatic scaling)
+    std::atomic<int> active_num { 0 };                  // number of active workers
+    std::atomic<bool> is_auto_scale { false };          // automatic scaling, disabled by manual set
+    std::mutex scale_mutex;                             // serialize scaling
+
+    // scaling samples (timer thread only)
+    int sample_count = 0;                               // samples in this round
+    int busy_sum = 0;                                   // sum of busy (not parked) active workers
+    int runnable_sum = 0;                               // sum of runnable queues
+    int idle_rounds = 0;                                // low utilization rounds in a row
+};
 
-    //
-    std::mutex mutex;                                   //
-    std::condition_variable cond;                       //
+// worker thread spin (adaptive, number of global mq pop attempts before park)
+enum
+{
+    WORKER_SPIN_MIN = 4,                                // min spin rounds
+    WORKER_SPIN_MAX = 128,                              // max spin rounds
+    WORKER_SPIN_RELAX = 32,                             // cpu relax per spin round
 };
 
+// worker scaling (sampled by timer thread every 2.5ms)
+enum
+{
+    SCALE_SAMPLES = 40,                                 // decide every n samples (100ms)
+    SCALE_UP_UTIL = 90,                                 // scale up: utilization (%) above, and runnable queues are waiting
+    SCALE_DOWN_UTIL = 50,                               // scale down: utilization (%) below for SCALE_DOWN_ROUNDS in a row
+    SCALE_DOWN_ROUNDS = 10,                             //
+};
+
+// threads of the node (worker scaling access)
+static monitor_data* s_monitor_data = nullptr;
+
 // sighup handle
 // SIGHUP 信号在用户终端连接(正常或非正常)结束时发出，通常是在终端的控制进程结束时, 通知同一session内的各个作业
 static volatile int SIG = 0;
@@ -46,25 +90,11 @@ static void handle_hup(int signal)
     }
 }
 
-// weight of the service worker thread: it determines the processing frequency of messages in the message queue
-// -1: process one message in message queue per update frame (每帧只处理mq中一个消息包)
-//  0: 每帧处理mq中所有消息包, process all messages in message queue per update frame
-//  1: 每帧处理mq长度的1/2条(>>1右移一位)消息, process 1/2 messages in message queue per update frame
-//  2: 每帧处理mq长度的1/4(右移2位), process 1/4 messages in message queue per update frame
-//  3: 每帧处理mq长度的1/8(右移3位), process 1/8 messages in message queue per update frame
-static int WORKER_THREAD_WEIGHT[] = {
-    -1, -1, -1, -1,              // 0 - 3
-    0, 0, 0, 0,                  // 4 - 7
-    1, 1, 1, 1, 1, 1, 1, 1,      // 8 - 15
-    2, 2, 2, 2, 2, 2, 2, 2,      // 16 - 23
-    3, 3, 3, 3, 3, 3, 3, 3,      // 24 - 31
-};
-
-const int WORKER_THREAD_WEIGHT_COUNT = sizeof(WORKER_THREAD_WEIGHT) / sizeof(WORKER_THREAD_WEIGHT[0]);
-
 // start threads
-void node_thread::start(int work_thread_num)
+void node_thread::start(const node_config& config)
 {
+    // worker threads are created for the max count, the others than config.thread_ start retired
+    int work_thread_num = config.thread_max_;
     // register hup signal handler, used for reopen log file, TODO: 废弃
     signal_helper::handle_sighup(&handle_hup);
 
@@ -74,31 +104,74 @@ void node_thread::start(int work_thread_num)
     //
     auto monitor_data_ptr = std::make_shared<monitor_data>();
     monitor_data_ptr->work_thread_num = work_thread_num;
-    monitor_data_ptr->work_thread_sleep_count = 0;
+    monitor_data_ptr->work_thread_min = config.thread_min_;
+    monitor_data_ptr->active_num.store(config.thread_);
+    monitor_data_ptr->is_auto_scale.store(config.thread_min_ < config.thread_max_);
 
     // worker thread monitor array
     monitor_data_ptr->svc_monitors.reset(new service_monitor[work_thread_num], std::default_delete<service_monitor[]>());
 
+    // worker thread parkers, wakeup an idle worker when a queue become runnable
+    monitor_data_ptr->parkers.reset(new parker[work_thread_num], std::default_delete<parker[]>());
+    monitor_data_ptr->idle_workers.reserve(work_thread_num);
+    mq_global::instance()->set_notify(&node_thread::_notify_worker, monitor_data_ptr.get());
+    s_monitor_data = monitor_data_ptr.get();
+
     // start monitor, timer, socket threads
     threads[0] = std::make_shared<std::thread>(node_thread::thread_monitor, monitor_data_ptr);
     threads[1] = std::make_shared<std::thread>(node_thread::thread_timer, monitor_data_ptr);
     threads[2] = std::make_shared<std::thread>(node_thread::thread_socket, monitor_data_ptr);
 
     // start worker threads
-    int weight = 0;
     for (int idx = 0; idx < work_thread_num; idx++)
     {
-        weight = idx < WORKER_THREAD_WEIGHT_COUNT ? WORKER_THREAD_WEIGHT[idx] : 0;
-        
-        //
-        threads[idx + 3] = std::make_shared<std::thread>(node_thread::thread_worker, monitor_data_ptr, idx, weight);
+        threads[idx + 3] = std::make_shared<std::thread>(node_thread::thread_worker, monitor_data_ptr, idx);
     }
 
+    // cpu affinity
+    _bind_threads(config, threads, work_thread_num);
+
     // wait all thread exit
     for (auto& thread : threads)
     {
         thread->join();
     }
+
+    mq_global::instance()->set_notify(nullptr, nullptr);
+    s_monitor_data = nullptr;
+}
+
+bool node_thread::worker_count(int& active, int& min, int& max, bool& is_auto)
+{
+    monitor_data* md = s_monitor_data;
+    if (md == nullptr)
+        return false;
+
+    active = md->active_num.load();
+    min = md->work_thread_min;
+    max = md->work_thread_num;
+    is_auto = md->is_auto_scale.load();
+
+    return true;
+}
+
+bool node_thread::set_worker_count(int count)
+{
+    monitor_data* md = s_monitor_data;
+    if (md == nullptr)
+        return false;
+
+    // automatic scaling
+    if (count <= 0)
+    {
+        md->is_auto_scale.store(md->work_thread_min < md->work_thread_num);
+        return true;
+    }
+
+    md->is_auto_scale.store(false);
+    _set_active(md, count);
+
+    return true;
 }
 
 void node_thread::thread_socket(std::shared_ptr<monitor_data> monitor_data_ptr)
@@ -114,6 +187,7 @@ void node_thread::thread_socket(std::shared_ptr<monitor_data> monitor_data_ptr)
             break;
 
         // error or has more messages, continue
+        // (ret > 0, the worker thread is waked by global mq when the socket message pushed)
         if (ret < 0)
         {
             // check abort
@@ -122,10 +196,6 @@ void node_thread::thread_socket(std::shared_ptr<monitor_data> monitor_data_ptr)
 
             continue;
         }
-
-        // ret > 0, warkup work thread to process socket message
-        if (monitor_data_ptr->work_thread_sleep_count >= monitor_data_ptr->work_thread_num)
-            monitor_data_ptr->cond.notify_one();
     }
 }
 
@@ -137,15 +207,19 @@ void node_thread::thread_timer(std::shared_ptr<monitor_data> monitor_data_ptr)
         timer_manager::instance()->update_time();
         // update socket server time
         node_socket::instance()->update_time();
+        // flush the record file
+        if (node_record::instance()->is_recording())
+            node_record::instance()->flush();
+        // worker scaling
+        if (monitor_data_ptr->is_auto_scale.load(std::memory_order_relaxed))
+            _auto_scale(monitor_data_ptr.get());
+        // free the retired service contexts (lock free grab)
+        epoch::instance()->collect();
 
         // check abort
         if (service_manager::instance()->svc_count() == 0)
             break;
 
-        // notify worker thread
-        if (monitor_data_ptr->work_thread_sleep_count >= 1)
-            monitor_data_ptr->cond.notify_one();
-
         // check once per 2.5ms
         std::this_thread::sleep_for(std::chrono::microseconds(2500));
 
@@ -172,9 +246,11 @@ void node_thread::thread_timer(std::shared_ptr<monitor_data> monitor_data_ptr)
     node_socket::instance()->exit();
 
     // exit all worker thread
-    std::unique_lock<std::mutex> lock(monitor_data_ptr->mutex);
-    monitor_data_ptr->is_work_thread_quit = true;
-    monitor_data_ptr->cond.notify_all();
+    monitor_data_ptr->is_work_thread_quit.store(true);
+    for (int i = 0; i < monitor_data_ptr->work_thread_num; i++)
+    {
+        monitor_data_ptr->parkers.get()[i].unpark();
+    }
 }
 
 /**
@@ -198,6 +274,7 @@ void node_thread::thread_monitor(std::shared_ptr<monitor_data> monitor_data_ptr)
         {
             monitor_data_ptr->svc_monitors.get()[i].check();
         }
+        node_exclusive::instance()->check();
 
         // check interval: 5 seconds
         for (int i = 0; i < 5; i++)
@@ -212,27 +289,261 @@ void node_thread::thread_monitor(std::shared_ptr<monitor_data> monitor_data_ptr)
     }
 }
 
-void node_thread::thread_worker(std::shared_ptr<monitor_data> monitor_data_ptr, int idx, int weight)
+void node_thread::thread_worker(std::shared_ptr<monitor_data> monitor_data_ptr, int idx)
 {
     service_monitor& svc_monitor = monitor_data_ptr->svc_monitors.get()[idx];
 
+    // use local run queue
+    mq_global::instance()->bind_worker(idx);
+
+    int spin = WORKER_SPIN_MIN;
     mq_private* q = nullptr;
     while (!monitor_data_ptr->is_work_thread_quit)
     {
+        // retired by worker scaling
+        if (idx >= monitor_data_ptr->active_num.load(std::memory_order_relaxed))
+        {
+            _retire(monitor_data_ptr.get(), idx, q);
+            q = nullptr;
+            continue;
+        }
+
         // process service message
-        q = node::instance()->dispatch_message(svc_monitor, q, weight);
+        q = node::instance()->dispatch_message(svc_monitor, q);
+        if (q != nullptr)
+            continue;
+
+        // no more message, spin a while
+        q = _spin(monitor_data_ptr.get(), spin);
+        if (q != nullptr)
+            continue;
+
+        // park
+        q = _park(monitor_data_ptr.get(), idx);
+    }
+}
+
+mq_private* node_thread::_spin(monitor_data* md, int& spin)
+{
+    // at most half of the active workers spin
+    int active_num = md->active_num.load(std::memory_order_relaxed);
+    int max_spinning = active_num / 2 > 0 ? active_num / 2 : 1;
+    if (md->spinning_count.fetch_add(1) >= max_spinning)
+    {
+        md->spinning_count.fetch_sub(1);
+        return nullptr;
+    }
+
+    mq_private* q = nullptr;
+    for (int i = 0; i < spin && q == nullptr; i++)
+    {
+        for (int j = 0; j < WORKER_SPIN_RELAX; j++)
+        {
+            parker::cpu_relax();
+        }
+
+        q = mq_global::instance()->pop();
+    }
+
+    md->spinning_count.fetch_sub(1);
+
+    // adaptive: spin longer if spinning pays off
+    if (q != nullptr)
+        spin = std::min(spin * 2, (int)WORKER_SPIN_MAX);
+    else
+        spin = std::max(spin / 2, (int)WORKER_SPIN_MIN);
+
+    return q;
+}
+
+mq_private* node_thread::_park(monitor_data* md, int idx)
+{
+    // publish as idle worker
+    {
+        std::lock_guard<std::mutex> lock(md->idle_mutex);
+        md->idle_workers.push_back(idx);
+        md->idle_count.fetch_add(1);
+    }
+
+    // check again, a queue may be pushed before we published as idle (and the producer saw no idle worker).
+    // pairs with the fence in _notify_worker(). retired meanwhile (see _set_active), don't park as idle worker.
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    mq_private* q = mq_global::instance()->pop();
+    if (q != nullptr || md->is_work_thread_quit || idx >= md->active_num.load())
+    {
+        // cancel parking. if a producer has taken us from idle list, the permit makes next park return at once.
+        std::lock_guard<std::mutex> lock(md->idle_mutex);
+        auto iter = std::find(md->idle_workers.begin(), md->idle_workers.end(), idx);
+        if (iter != md->idle_workers.end())
+        {
+            md->idle_workers.erase(iter);
+            md->idle_count.fetch_sub(1);
+        }
+
+        return q;
+    }
+
+    md->parkers.get()[idx].park();
+
+    return nullptr;
+}
+
+void node_thread::_notify_worker(void* ud)
+{
+    monitor_data* md = (monitor_data*)ud;
+
+    // a spinning worker will find the queue, pairs with the fence in _park()
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (md->spinning_count.load(std::memory_order_relaxed) > 0 || md->idle_count.load(std::memory_order_relaxed) == 0)
+        return;
+
+    // wakeup exactly one parked worker
+    int idx = -1;
+    {
+        std::lock_guard<std::mutex> lock(md->idle_mutex);
+        if (!md->idle_workers.empty())
+        {
+            idx = md->idle_workers.back();
+            md->idle_workers.pop_back();
+            md->idle_count.fetch_sub(1);
+        }
+    }
+
+    if (idx >= 0)
+    {
+        md->parkers.get()[idx].unpark();
+    }
+}
+
+void node_thread::_retire(monitor_data* md, int idx, mq_private* q)
+{
+    // give back the queue in hand and the local run queue
+    if (q != nullptr)
+    {
+        mq_global::instance()->push(q, q->is_high_pending());
+    }
+    mq_global::instance()->drain_worker();
+
+    // the drained queues (or a wakeup this worker took) go to an active worker
+    _notify_worker(md);
+
+    // park until activated again
+    while (idx >= md->active_num.load() && !md->is_work_thread_quit)
+    {
+        md->parkers.get()[idx].park();
+    }
+}
+
+void node_thread::_set_active(monitor_data* md, int count)
+{
+    std::lock_guard<std::mutex> scale_lock(md->scale_mutex);
+
+    count = std::max(1, std::min(count, md->work_thread_num));
+    int old_count = md->active_num.load();
+    if (count == old_count)
+        return;
+
+    md->active_num.store(count);
+    if (count < old_count)
+    {
+        // the retired workers leave the idle list, and wake up to drain their local run queue
+        std::lock_guard<std::mutex> lock(md->idle_mutex);
+        auto iter = std::remove_if(md->idle_workers.begin(), md->idle_workers.end(), [count](int idx) { return idx >= count; });
+        md->idle_count.fetch_sub((int)(md->idle_workers.end() - iter));
+        md->idle_workers.erase(iter, md->idle_workers.end());
+    }
+    for (int idx = std::min(count, old_count); idx < std::max(count, old_count); idx++)
+    {
+        md->parkers.get()[idx].unpark();
+    }
+
+    log_info(nullptr, fmt::format("worker threads: {} -> {}", old_count, count));
+}
+
+void node_thread::_auto_scale(monitor_data* md)
+{
+    // sample
+    int active_num = md->active_num.load(std::memory_order_relaxed);
+    int busy = active_num - md->idle_count.load(std::memory_order_relaxed);
+    md->busy_sum += std::max(busy, 0);
+    md->runnable_sum += mq_global::instance()->runnable_count();
+    if (++md->sample_count < SCALE_SAMPLES)
+        return;
+
+    // utilization (%) and average runnable queues of this round
+    int util = md->busy_sum * 100 / (md->sample_count * active_num);
+    int runnable = md->runnable_sum / md->sample_count;
+    md->sample_count = 0;
+    md->busy_sum = 0;
+    md->runnable_sum = 0;
+
+    // saturated, and queues are waiting for a worker
+    if (util >= SCALE_UP_UTIL && runnable > 0)
+    {
+        md->idle_rounds = 0;
+        if (active_num < md->work_thread_num)
+        {
+            _set_active(md, active_num + 1);
+        }
+    }
+    // under used for a while
+    else if (util < SCALE_DOWN_UTIL)
+    {
+        if (++md->idle_rounds >= SCALE_DOWN_ROUNDS && active_num > md->work_thread_min)
+        {
+            md->idle_rounds = 0;
+            _set_active(md, active_num - 1);
+        }
+    }
+    else
+    {
+        md->idle_rounds = 0;
+    }
+}
+
+void node_thread::_bind_threads(const node_config& config, std::shared_ptr<std::thread>* threads, int work_thread_num)
+{
+    log_info(nullptr, fmt::format("cpu topology: {}", cpu_affinity::topology()));
+
+    // monitor, timer, socket threads: pinned to the cpu set
+    struct
+    {
+        const char* role;
+        const std::vector<int>& cpus;
+    } roles[] = {
+        { "monitor", config.affinity_monitor_ },
+        { "timer", config.affinity_timer_ },
+        { "socket", config.affinity_socket_ },
+    };
+    for (int i = 0; i < 3; i++)
+    {
+        auto& r = roles[i];
+        if (!r.cpus.empty() && !cpu_affinity::bind(*threads[i], r.cpus))
+        {
+            log_warn(nullptr, fmt::format("{} thread bind cpu failed", r.role));
+        }
+        log_info(nullptr, fmt::format("{} thread: cpu {}", r.role, cpu_affinity::to_string(r.cpus)));
+    }
+
+    // worker threads: each worker pinned to one cpu (round robin), thread placement only (memory placement is left to the os).
+    auto& cpus = config.affinity_worker_;
+    if (cpus.empty())
+    {
+        log_info(nullptr, "worker threads: cpu any");
+        return;
+    }
 
-        // no more message, sleep
-        if (q == nullptr)
+    std::vector<int> worker_cpus;
+    for (int idx = 0; idx < work_thread_num; idx++)
+    {
+        std::vector<int> cpu { cpus[idx % cpus.size()] };
+        if (!cpu_affinity::bind(*threads[idx + 3], cpu))
         {
-            std::unique_lock<std::mutex> lock(monitor_data_ptr->mutex);
-            
-            ++monitor_data_ptr->work_thread_sleep_count;
-            if (!monitor_data_ptr->is_work_thread_quit)
-                monitor_data_ptr->cond.wait(lock);
-            --monitor_data_ptr->work_thread_sleep_count;
+            log_warn(nullptr, fmt::format("worker thread {} bind cpu failed", idx));
         }
+        worker_cpus.push_back(cpu[0]);
     }
+    log_info(nullptr, fmt::format("worker threads: cpu {}", cpu_affinity::to_string(worker_cpus)));
 }
 
 }
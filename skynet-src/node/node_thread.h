@@ -1,18 +1,30 @@
 #pragma once
 
 #include <memory>
+#include <thread>
 
 namespace skynet {
 
 // forward declare
 struct monitor_data;
+class mq_private;
+class node_config;
 
 // server thread manager (timer, monitor, socket, work thread)
+// worker threads are created for thread_max, workers out of the active count are retired (parked, no local run queue).
+// the active count scales between thread_min and thread_max by worker utilization and runnable queues (timer thread),
+// or set by the THREAD command.
 class node_thread final
 {
 public:
-    // start threads
-    static void start(int work_thread_num);
+    // start threads (worker thread count & cpu affinity from node config)
+    static void start(const node_config& config);
+
+    // worker scaling: query the number of active worker threads, the scaling range, and automatic scaling flag
+    // return false if the threads are not started
+    static bool worker_count(int& active, int& min, int& max, bool& is_auto);
+    // worker scaling: set the number of active worker threads (manual, clamped to [1, max]), 0: automatic scaling
+    static bool set_worker_count(int count);
 
     // node thread routine (timer, monitor, socket, worker thread)
 private:
@@ -23,7 +35,25 @@ private:
     // monitor thread proc
     static void thread_monitor(std::shared_ptr<monitor_data> monitor_data_ptr);
     // worker thread proc
-    static void thread_worker(std::shared_ptr<monitor_data> monitor_data_ptr, int idx, int weight);
+    static void thread_worker(std::shared_ptr<monitor_data> monitor_data_ptr, int idx);
+
+private:
+    // worker thread: spin a while to find a runnable queue (adaptive spin rounds)
+    static mq_private* _spin(monitor_data* md, int& spin);
+    // worker thread: park until a queue become runnable
+    static mq_private* _park(monitor_data* md, int idx);
+    // wakeup a parked worker thread (global mq notify function)
+    static void _notify_worker(void* ud);
+    // worker thread: retire (worker index >= active count), drain the local run queue and park until activated again
+    static void _retire(monitor_data* md, int idx, mq_private* q);
+
+    // worker scaling: set the number of active workers
+    static void _set_active(monitor_data* md, int count);
+    // worker scaling: sample utilization & runnable queues, scale up or down (called by timer thread)
+    static void _auto_scale(monitor_data* md);
+
+    // pin threads to cpus by config, and log the effective topology
+    static void _bind_threads(const node_config& config, std::shared_ptr<std::thread>* threads, int work_thread_num);
 };
 
 }
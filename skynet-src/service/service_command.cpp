@@ -7,6 +7,7 @@
 
 #include "../node/node.h"
 #include "../node/node_env.h"
+#include "../node/node_thread.h"
 
 #include "../log/log.h"
 
@@ -18,6 +19,7 @@
 #include "../utils/time_helper.h"
 
 #include <cstdio>
+#include <cinttypes>
 #include <unordered_map>
 
 namespace skynet {
@@ -120,15 +122,22 @@ const char* cmd_register(service_context* svc_ctx, const char* param)
 // 发送消息前先要找到对应的ctx，才能给ctx发送消息
 const char* cmd_query(service_context* svc_ctx, const char* param)
 {
+    uint32_t svc_handle = 0;
     // local service
     if (param[0] == '.')
     {
-        uint32_t svc_handle = service_manager::instance()->find_by_name(param + 1);
-        if (svc_handle != 0)
-        {
-            ::sprintf(svc_ctx->cmd_result_, ":%x", svc_handle);
-            return svc_ctx->cmd_result_;
-        }
+        svc_handle = service_manager::instance()->find_by_name(param + 1);
+    }
+    // global service (local address of the global name)
+    else if (param[0] != ':')
+    {
+        svc_handle = service_manager::instance()->find_global_name(svc_ctx, param);
+    }
+
+    if (svc_handle != 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, ":%x", svc_handle);
+        return svc_ctx->cmd_result_;
     }
 
     return nullptr;
@@ -160,6 +169,30 @@ const char* cmd_name(service_context* svc_ctx, const char* param)
     return nullptr;
 }
 
+// skynet cmd: gname, apply a global name update (replicated by clusterd)
+// param: "name :address version", address: the service or the proxy of a remote service, :0 means removed
+// the caller is told (text message) when the service of the name exits
+// return "1" if applied, nullptr if stale
+const char* cmd_gname(service_context* svc_ctx, const char* param)
+{
+    int size = ::strlen(param);
+    char name[size + 1];
+    char svc_handle[size + 1];
+    unsigned long long version = 0;
+    if (::sscanf(param, "%s %s %llu", name, svc_handle, &version) != 3 || svc_handle[0] != ':' || name[0] == '.' || name[0] == ':')
+    {
+        log_error(svc_ctx, fmt::format("Invalid global name update {}", param));
+        return nullptr;
+    }
+
+    uint32_t handle_id = ::strtoul(svc_handle + 1, nullptr, 16);
+    if (!service_manager::instance()->set_global_name(name, handle_id, version, svc_ctx->svc_handle_))
+        return nullptr;
+
+    ::strcpy(svc_ctx->cmd_result_, "1");
+    return svc_ctx->cmd_result_;
+}
+
 // skynet cmd: exit, 服务主动退出
 // cmd_kill杀掉某个服务（被动），都会调用到handle_exit，
 // 然后调用到skynet_handle_retire，回收ctx->handle，供之后创建新的ctx使用，并将引用计数-1，
@@ -280,6 +313,85 @@ const char* cmd_stat(service_context* svc_ctx, const char* param)
         int len = svc_ctx->queue_->length();
         sprintf(svc_ctx->cmd_result_, "%d", len);
     }
+    // mailbox memory: slots allocated, peak length, bytes
+    else if (::strcmp(param, "mqslots") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%d", svc_ctx->queue_->slot_count());
+    }
+    else if (::strcmp(param, "mqpeak") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%d", svc_ctx->queue_->peak_length());
+    }
+    else if (::strcmp(param, "mqmem") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%zu", svc_ctx->queue_->memory_usage());
+    }
+    // number of messages handled by each priority lane
+    else if (::strcmp(param, "lane_high") == 0)
+    {
+        uint64_t count = svc_ctx->queue_->lane_pop_count(mq_private::LANE_HIGH);
+        ::sprintf(svc_ctx->cmd_result_, "%" PRIu64, count);
+    }
+    else if (::strcmp(param, "lane_normal") == 0)
+    {
+        uint64_t count = svc_ctx->queue_->lane_pop_count(mq_private::LANE_NORMAL);
+        ::sprintf(svc_ctx->cmd_result_, "%" PRIu64, count);
+    }
+    // bounded mailbox
+    else if (::strcmp(param, "capacity") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%d", svc_ctx->queue_->capacity());
+    }
+    else if (::strcmp(param, "reject") == 0)
+    {
+        uint64_t count = svc_ctx->queue_->reject_count_.load(std::memory_order_relaxed);
+        ::sprintf(svc_ctx->cmd_result_, "%" PRIu64, count);
+    }
+    else if (::strcmp(param, "drop") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%" PRIu64, svc_ctx->queue_->drop_count_);
+    }
+    // sojourn time (milliseconds) & overload control
+    else if (::strncmp(param, "sojourn_p", 9) == 0)
+    {
+        uint64_t ns = svc_ctx->queue_->codel_.percentile(::atoi(param + 9));
+        ::sprintf(svc_ctx->cmd_result_, "%lf", (double)ns / 1000000.0);
+    }
+    else if (::strcmp(param, "sojourn_max") == 0)
+    {
+        uint64_t ns = svc_ctx->queue_->codel_.max_sojourn();
+        ::sprintf(svc_ctx->cmd_result_, "%lf", (double)ns / 1000000.0);
+    }
+    else if (::strcmp(param, "shed") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%" PRIu64, svc_ctx->queue_->codel_.shed_count());
+    }
+    else if (::strcmp(param, "defer") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%" PRIu64, svc_ctx->queue_->codel_.defer_count());
+    }
+    // cpu quota: percent, number of windows over quota
+    else if (::strcmp(param, "quota") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%d", svc_ctx->cpu_quota_);
+    }
+    else if (::strcmp(param, "quota_throttle") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%" PRIu64, svc_ctx->quota_throttle_count_);
+    }
+    // outstanding calls: sent by this service, sent to this service, expired
+    else if (::strcmp(param, "call_pending") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%d", svc_ctx->sessions_.pending_count());
+    }
+    else if (::strcmp(param, "call_inbound") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%d", svc_ctx->call_inbound_->load(std::memory_order_relaxed));
+    }
+    else if (::strcmp(param, "call_timeout") == 0)
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%" PRIu64, svc_ctx->sessions_.timeout_count());
+    }
     // maybe dead loop or blocked
     else if (::strcmp(param, "is_blocked") == 0)
     {
@@ -296,7 +408,7 @@ const char* cmd_stat(service_context* svc_ctx, const char* param)
     // cpu usage
     else if (::strcmp(param, "cpu") == 0)
     {
-        double t = (double)svc_ctx->cpu_cost_ / 1000000.0;    // microsecond
+        double t = (double)svc_ctx->cpu_cost_.load(std::memory_order_relaxed) / 1000000.0;    // microsecond
         ::sprintf(svc_ctx->cmd_result_, "%lf", t);
     }
     // 
@@ -316,7 +428,7 @@ const char* cmd_stat(service_context* svc_ctx, const char* param)
     // message count
     else if (::strcmp(param, "message") == 0)
     {
-        ::sprintf(svc_ctx->cmd_result_, "%d", svc_ctx->message_count_);
+        ::sprintf(svc_ctx->cmd_result_, "%d", svc_ctx->message_count_.load(std::memory_order_relaxed));
     }
     // 
     else
@@ -327,6 +439,218 @@ const char* cmd_stat(service_context* svc_ctx, const char* param)
     return svc_ctx->cmd_result_;
 }
 
+// skynet cmd: mailbox
+// set the mailbox capacity and policy of current service
+// @param param "capacity [policy]", capacity 0: unlimited, policy: reject (default) | drop | throttle
+const char* cmd_mailbox(service_context* svc_ctx, const char* param)
+{
+    if (param == nullptr || param[0] == '\0')
+    {
+        ::sprintf(svc_ctx->cmd_result_, "%d", svc_ctx->queue_->capacity());
+        return svc_ctx->cmd_result_;
+    }
+
+    char* policy_str = nullptr;
+    int capacity = ::strtol(param, &policy_str, 10);
+    while (*policy_str == ' ')
+    {
+        ++policy_str;
+    }
+
+    int policy = mq_private::POLICY_REJECT;
+    if (policy_str[0] == '\0' || ::strcmp(policy_str, "reject") == 0)
+    {
+        policy = mq_private::POLICY_REJECT;
+    }
+    else if (::strcmp(policy_str, "drop") == 0)
+    {
+        policy = mq_private::POLICY_DROP_OLDEST;
+    }
+    else if (::strcmp(policy_str, "throttle") == 0)
+    {
+        policy = mq_private::POLICY_THROTTLE;
+    }
+    else
+    {
+        log_error(svc_ctx, fmt::format("Invalid mailbox policy: {}", policy_str));
+        return nullptr;
+    }
+
+    svc_ctx->queue_->set_capacity(capacity, policy);
+
+    return nullptr;
+}
+
+// skynet cmd: codel
+// set the sojourn time overload policy of current service
+// @param param "target_ms interval_ms mode [type ...]", mode (required): off | shed | defer, type: droppable message types (default: client)
+const char* cmd_codel(service_context* svc_ctx, const char* param)
+{
+    if (param == nullptr || param[0] == '\0')
+        return nullptr;
+
+    char* end = nullptr;
+    double target_ms = ::strtod(param, &end);
+    double interval_ms = ::strtod(end, &end);
+    while (*end == ' ')
+    {
+        ++end;
+    }
+
+    const char* mode_str = end;
+    int mode_len = 0;
+    while (mode_str[mode_len] != '\0' && mode_str[mode_len] != ' ')
+    {
+        ++mode_len;
+    }
+
+    // the exact token, a missing mode is invalid
+    int mode = mq_codel::MODE_OFF;
+    if (mode_len == 3 && ::strncmp(mode_str, "off", 3) == 0)
+    {
+        mode = mq_codel::MODE_OFF;
+    }
+    else if (mode_len == 4 && ::strncmp(mode_str, "shed", 4) == 0)
+    {
+        mode = mq_codel::MODE_SHED;
+    }
+    else if (mode_len == 5 && ::strncmp(mode_str, "defer", 5) == 0)
+    {
+        mode = mq_codel::MODE_DEFER;
+    }
+    else
+    {
+        log_error(svc_ctx, fmt::format("Invalid codel mode: {}", std::string(mode_str, mode_len)));
+        return nullptr;
+    }
+
+    if (target_ms <= 0 || interval_ms <= 0)
+    {
+        log_error(svc_ctx, fmt::format("Invalid codel param: {}", param));
+        return nullptr;
+    }
+
+    // droppable message types, response/system/error are never dropped
+    uint32_t types = 0;
+    const char* p = mode_str + mode_len;
+    for (;;)
+    {
+        long type = ::strtol(p, &end, 10);
+        if (end == p)
+            break;
+        p = end;
+        if (type < 0 || type >= 32 || type == SERVICE_MSG_TYPE_RESPONSE || type == SERVICE_MSG_TYPE_SYSTEM || type == SERVICE_MSG_TYPE_ERROR)
+        {
+            log_error(svc_ctx, fmt::format("Invalid codel message type: {}", type));
+            return nullptr;
+        }
+        types |= 1u << type;
+    }
+    if (types == 0)
+    {
+        types = 1u << SERVICE_MSG_TYPE_CLIENT;
+    }
+
+    svc_ctx->queue_->codel_.set_policy(mode, (uint64_t)(target_ms * 1000000), (uint64_t)(interval_ms * 1000000), types);
+
+    return nullptr;
+}
+
+// skynet cmd: pool
+// join/leave a service pool (current service)
+// @param param "join .name [length|sojourn]" | "leave .name", route: length (default, shortest queue) | sojourn (lowest sojourn time)
+const char* cmd_pool(service_context* svc_ctx, const char* param)
+{
+    if (param == nullptr)
+        return nullptr;
+
+    char op[8] = { 0 };
+    char name[64] = { 0 };
+    char route_str[16] = { 0 };
+    int n = ::sscanf(param, "%7s %63s %15s", op, name, route_str);
+    if (n < 2 || name[0] != '.')
+    {
+        log_error(svc_ctx, fmt::format("Invalid pool param: {}", param));
+        return nullptr;
+    }
+
+    if (::strcmp(op, "join") == 0)
+    {
+        int route = service_manager::POOL_ROUTE_LENGTH;
+        if (n == 3 && ::strcmp(route_str, "sojourn") == 0)
+        {
+            route = service_manager::POOL_ROUTE_SOJOURN;
+        }
+        else if (n == 3 && ::strcmp(route_str, "length") != 0)
+        {
+            log_error(svc_ctx, fmt::format("Invalid pool route: {}", route_str));
+            return nullptr;
+        }
+
+        if (!service_manager::instance()->pool_join(name + 1, svc_ctx->svc_handle_, route))
+        {
+            log_error(svc_ctx, fmt::format("Can't join pool {}, the name is used by a service", name));
+        }
+    }
+    else if (::strcmp(op, "leave") == 0)
+    {
+        service_manager::instance()->pool_leave(name + 1, svc_ctx->svc_handle_);
+    }
+    else
+    {
+        log_error(svc_ctx, fmt::format("Invalid pool op: {}", op));
+    }
+
+    return nullptr;
+}
+
+// skynet cmd: quota
+// set the cpu quota of current service (percent of one worker thread per window, 0: unlimited)
+// over quota, the service runs after the other services until the window resets
+// @param param "percent"
+const char* cmd_quota(service_context* svc_ctx, const char* param)
+{
+    if (param == nullptr || param[0] == '\0')
+        return nullptr;
+
+    int percent = ::atoi(param);
+    svc_ctx->cpu_quota_ = percent > 0 ? percent : 0;
+    // start a new window
+    svc_ctx->quota_start_ns_ = 0;
+    svc_ctx->queue_->is_low_.store(false, std::memory_order_relaxed);
+
+    return nullptr;
+}
+
+// skynet cmd: thread
+// query or set the number of active worker threads
+// @param param "" (query) | "auto" (automatic scaling between thread_min and thread_max) | "n" (n active workers, manual)
+// @return "active min max auto|manual"
+const char* cmd_thread(service_context* svc_ctx, const char* param)
+{
+    if (param != nullptr && param[0] != '\0')
+    {
+        int count = ::strcmp(param, "auto") == 0 ? 0 : ::atoi(param);
+        if (count <= 0 && ::strcmp(param, "auto") != 0)
+        {
+            log_error(svc_ctx, fmt::format("Invalid thread param: {}", param));
+            return nullptr;
+        }
+
+        node_thread::set_worker_count(count);
+    }
+
+    int active = 0;
+    int min = 0;
+    int max = 0;
+    bool is_auto = false;
+    if (!node_thread::worker_count(active, min, max, is_auto))
+        return nullptr;
+
+    ::sprintf(svc_ctx->cmd_result_, "%d %d %d %s", active, min, max, is_auto ? "auto" : "manual");
+    return svc_ctx->cmd_result_;
+}
+
 // skynet cmd: log_on
 // set service file log on
 const char* cmd_service_log_on(service_context* context, const char* param)
@@ -422,6 +746,7 @@ static std::unordered_map<std::string, cmd_proc> cmd_map {
     { "REGISTER", cmd_register },
     { "QUERY", cmd_query },
     { "NAME", cmd_name },
+    { "GNAME", cmd_gname },
     { "EXIT", cmd_exit },
     { "KILL", cmd_kill },
     { "LAUNCH", cmd_launch },
@@ -431,6 +756,11 @@ static std::unordered_map<std::string, cmd_proc> cmd_map {
     { "ABORT", cmd_abort },
     { "MONITOR", cmd_monitor },
     { "STAT", cmd_stat },
+    { "MAILBOX", cmd_mailbox },
+    { "CODEL", cmd_codel },
+    { "POOL", cmd_pool },
+    { "QUOTA", cmd_quota },
+    { "THREAD", cmd_thread },
     { "LOG_ON", cmd_service_log_on },
     { "LOG_OFF", cmd_service_log_off },
     { "SIGNAL", cmd_signal },
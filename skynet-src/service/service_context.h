@@ -3,6 +3,12 @@
 #include <stdio.h>
 #include <cstdint>
 #include <atomic>
+#include <string>
+#include <memory>
+#include <unordered_map>
+
+#include "service_session.h"
+#include "service_name_cache.h"
 
 namespace skynet {
 
@@ -31,6 +37,7 @@ public:
     // callback
     void* cb_ud_ = nullptr;                     // service message callback function argument, 调用callback函数时, 回传给callback的 user data, 一般是instance指针
     skynet_cb msg_callback_ = nullptr;          // service message callback function
+    bool is_forward_ = false;                   // forward mode, the callback keeps the message data (return 1)
 
     //
     mq_private* queue_ = nullptr;               // service private queue
@@ -47,23 +54,46 @@ public:
     bool is_init_ = false;                      // service initialize tag
     bool is_blocked_ = false;                   // service blocked tag
                                                 // set by service monitor thread when service dead lock or blocked.
+    bool is_send_throttled_ = false;            // a message has been sent to a full mailbox (throttle policy), reset by the sender
+
+    // name cache (owner thread only, see service_manager::find_by_name)
+    service_name_cache name_cache_;             // service name -> service handle
+    service_name_cache global_name_cache_;      // global name -> local address
+    uint64_t name_cache_gen_ = 0;               // name registry generation of the cache
 
-    // stat
-    int message_count_ = 0;                     // 累计收到的消息数量
+    // call sessions
+    service_session sessions_;                  // outstanding calls sent by this service
+    // outstanding calls to this service (overload signal), the counter is shared with the callers' tracked calls,
+    // a caller releases its call without grabbing this context
+    std::shared_ptr<std::atomic<int>> call_inbound_ { std::make_shared<std::atomic<int>>(0) };
+
+    // stat (written by owner, the atomic ones are read by any thread, see service_manager::stat_all)
+    std::atomic<int> message_count_ { 0 };      // 累计收到的消息数量
+    std::atomic<uint64_t> message_cost_ { 0 };  // average dispatch cost per message (nanoseconds), used by dispatch budget and pool routing
+    std::atomic<uint64_t> mem_usage_ { 0 };     // memory used by the service module (snlua: lua vm, updated after each message), 0: unknown
 
     // cpu usage
-    uint64_t cpu_cost_ = 0;                     // in microsec
+    std::atomic<uint64_t> cpu_cost_ { 0 };      // in microsec
     uint64_t cpu_start_ = 0;                    // in microsec
     bool profile_ = false;                      // 标记是否需要开启性能监测(记录cpu调用时间)
 
+    // cpu quota (see node::dispatch_message)
+    int cpu_quota_ = 0;                         // cpu share of one worker thread per window (percent), 0: unlimited
+    uint64_t quota_start_ns_ = 0;               // current quota window start time
+    uint64_t quota_base_ = 0;                   // cpu_cost_ at the window start (microsec)
+    uint64_t quota_throttle_count_ = 0;         // number of windows the service went over quota
+
 public:
     // new session id
     int new_session();
 
     //
     void grab();
+    // grab if the ref count is not 0 (the context may be released concurrently), return false if released
+    bool try_grab();
 
-    void set_callback(skynet_cb cb, void* cb_ud = nullptr);
+    // is_forward: the callback keeps the message data (return 1)
+    void set_callback(skynet_cb cb, void* cb_ud = nullptr, bool is_forward = false);
 };
 
 }
@@ -18,10 +18,23 @@ inline void service_context::grab()
     ++ref_;
 }
 
-inline void service_context::set_callback(skynet_cb msg_callback, void* cb_ud/* = nullptr*/)
+inline bool service_context::try_grab()
+{
+    int ref = ref_.load(std::memory_order_relaxed);
+    while (ref > 0)
+    {
+        if (ref_.compare_exchange_weak(ref, ref + 1))
+            return true;
+    }
+
+    return false;
+}
+
+inline void service_context::set_callback(skynet_cb msg_callback, void* cb_ud/* = nullptr*/, bool is_forward/* = false*/)
 {
     msg_callback_ = msg_callback;
     cb_ud_ = cb_ud;
+    is_forward_ = is_forward;
 }
 
 }
@@ -4,6 +4,7 @@
 #include "../mod/mod_manager.h"
 
 #include "../node/node.h"
+#include "../node/node_exclusive.h"
 
 #include "../log/log.h"
 
@@ -11,8 +12,13 @@
 #include "../mq/mq_private.h"
 #include "../mq/mq_global.h"
 
+#include "../utils/epoch.h"
+
 #include <cstring>
 #include <mutex>
+#include <algorithm>
+#include <tuple>
+#include <new>
 
 namespace skynet {
 
@@ -37,22 +43,18 @@ service_manager* service_manager::instance()
 bool service_manager::init()
 {
     // 给slot分配slot_size个ctx内存
-    svc_ctx_slot_size_ = DEFAULT_SLOT_SIZE;
-    svc_ctx_slot_ = new service_context* [svc_ctx_slot_size_] { nullptr };
+    slot_table_.store(_new_slot_table(DEFAULT_SLOT_SIZE));
 
     alloc_svc_handle_seed_ = 1;
-    name_cap_ = 2;
-    name_count_ = 0;
-
-    //
-    name_ = new handle_name[name_cap_];
+    names_.clear();
+    handle_names_.clear();
 
     svc_count_ = 0;
 
     return true;
 }
 
-service_context* service_manager::create_service(const char* svc_name, const char* svc_args)
+service_context* service_manager::create_service(const char* svc_name, const char* svc_args, bool is_exclusive/* = false*/)
 {
     // query c service mod info
     auto mod_ptr = mod_manager::instance()->query(svc_name);
@@ -70,7 +72,7 @@ service_context* service_manager::create_service(const char* svc_name, const cha
         return nullptr;
 
     // create service context
-    auto svc_ctx = new service_context;
+    auto svc_ctx = _new_service();
 
     svc_ctx->svc_mod_ptr_ = mod_ptr;
     svc_ctx->svc_ptr_ = svc_ptr;
@@ -87,11 +89,12 @@ service_context* service_manager::create_service(const char* svc_name, const cha
     svc_ctx->cpu_start_ = 0;
     svc_ctx->message_count_ = 0;
     svc_ctx->profile_ = node::instance()->is_profile();
+    svc_ctx->cpu_quota_ = node::instance()->cpu_quota(svc_name, svc_args);
 
     // Should set to 0 first to avoid unregister_service_all() get an uninitialized handle
     // initialize function maybe use svc_ctx->svc_handle_, so it must init at last
     svc_ctx->svc_handle_ = 0;
-    svc_ctx->svc_handle_ = register_service(svc_ctx); // register service context and get service handle
+    register_service(svc_ctx); // register service context and set service handle (before the context is visible to grab())
 
     // initialize service private queue
     mq_private* queue = mq_private::create(svc_ctx->svc_handle_);
@@ -107,8 +110,15 @@ service_context* service_manager::create_service(const char* svc_name, const cha
         if (ret != nullptr)
             svc_ctx->is_init_ = true;
 
-        // put service private queue into global mq. service can recv message now.
-        mq_global::instance()->push(queue);
+        // put service private queue into global mq (or its own thread). service can recv message now.
+        if (is_exclusive || node::instance()->is_exclusive(svc_name, svc_args))
+        {
+            node_exclusive::instance()->start(queue);
+        }
+        else
+        {
+            mq_global::instance()->push(queue);
+        }
         if (ret != nullptr)
             log_info(ret, fmt::format("LAUNCH {} {}", svc_name, svc_args != nullptr ? svc_args : ""));
 
@@ -136,67 +146,95 @@ uint32_t service_manager::register_service(service_context* svc_ctx)
 
     for (;;)
     {
+        slot_table* table = slot_table_.load(std::memory_order_relaxed);
         uint32_t svc_handle = alloc_svc_handle_seed_;
-        for (int i = 0; i < svc_ctx_slot_size_; i++, svc_handle++)
+        for (int i = 0; i < table->size; i++, svc_handle++)
         {
             if (svc_handle > HANDLE_MASK)
             {
                 // 0 is reserved
                 svc_handle = 1;
             }
-            int hash = svc_handle & (svc_ctx_slot_size_ - 1);
-            if (svc_ctx_slot_[hash] == nullptr)
+            int hash = svc_handle & (table->size - 1);
+            if (table->slots[hash].load(std::memory_order_relaxed) == nullptr)
             {
-                svc_ctx_slot_[hash] = svc_ctx;
+                svc_ctx->svc_handle_ = svc_handle;
+                table->slots[hash].store(svc_ctx, std::memory_order_release);
                 alloc_svc_handle_seed_ = svc_handle + 1;
 
                 return svc_handle;
             }
         }
-        assert((svc_ctx_slot_size_ * 2 - 1) <= HANDLE_MASK);
-        service_context** new_slot = new service_context* [2 * svc_ctx_slot_size_];
-        ::memset(new_slot, 0, svc_ctx_slot_size_ * 2 * sizeof(service_context*));
-        for (int i = 0; i < svc_ctx_slot_size_; i++)
+        assert((table->size * 2 - 1) <= HANDLE_MASK);
+        slot_table* new_table = _new_slot_table(table->size * 2);
+        for (int i = 0; i < table->size; i++)
         {
-            int hash = svc_ctx_slot_[i]->svc_handle_ & (svc_ctx_slot_size_ * 2 - 1);
-            assert(new_slot[hash] == nullptr);
-            new_slot[hash] = svc_ctx_slot_[i];
+            service_context* ctx = table->slots[i].load(std::memory_order_relaxed);
+            int hash = ctx->svc_handle_ & (new_table->size - 1);
+            assert(new_table->slots[hash].load(std::memory_order_relaxed) == nullptr);
+            new_table->slots[hash].store(ctx, std::memory_order_relaxed);
         }
 
-        delete[] svc_ctx_slot_;
-        svc_ctx_slot_ = new_slot;
-        svc_ctx_slot_size_ *= 2;
+        // readers may still use the old array
+        slot_table_.store(new_table, std::memory_order_release);
+        epoch::instance()->retire(table, _delete_slot_table);
     }
 }
 
 int service_manager::unregister_service(uint32_t svc_handle)
 {
     int ret = 0;
+    std::vector<std::pair<uint32_t, std::string>> gname_notify;     // registrar, global name
 
     // write lock
     std::unique_lock<std::shared_mutex> wlock(rw_mutex_);
 
-    uint32_t hash = svc_handle & (svc_ctx_slot_size_ - 1);
-    service_context* svc_ctx = svc_ctx_slot_[hash];
+    slot_table* table = slot_table_.load(std::memory_order_relaxed);
+    uint32_t hash = svc_handle & (table->size - 1);
+    service_context* svc_ctx = table->slots[hash].load(std::memory_order_relaxed);
 
     if (svc_ctx != nullptr && svc_ctx->svc_handle_ == svc_handle)
     {
-        svc_ctx_slot_[hash] = nullptr;
+        table->slots[hash].store(nullptr, std::memory_order_release);
         ret = 1;
-        int j = 0, n = name_count_;
-        for (int i = 0; i < n; ++i)
+
+        // remove names, invalidate the name caches
+        auto name_iter = handle_names_.find(svc_handle);
+        if (name_iter != handle_names_.end())
         {
-            if (name_[i].svc_handle == svc_handle)
-            {
+            for (auto& svc_name : name_iter->second)
+                names_.erase(svc_name);
+            handle_names_.erase(name_iter);
+            name_gen_.fetch_add(1, std::memory_order_release);
+        }
+
+        // remove global names bound to the service (keep the version), the registrar publishes the removal
+        for (auto& gname : global_names_)
+        {
+            if (gname.second.svc_handle != svc_handle)
                 continue;
+
+            gname.second.svc_handle = 0;
+            if (gname.second.registrar != 0 && gname.second.registrar != svc_handle)
+                gname_notify.emplace_back(gname.second.registrar, gname.first);
+            name_gen_.fetch_add(1, std::memory_order_release);
+        }
+
+        // leave pools
+        for (auto iter = pools_.begin(); iter != pools_.end();)
+        {
+            auto& members = iter->second.svc_handles;
+            members.erase(std::remove(members.begin(), members.end(), svc_handle), members.end());
+            if (members.empty())
+            {
+                iter = pools_.erase(iter);
+                --pool_count_;
             }
-            else if (i != j)
+            else
             {
-                name_[j] = name_[i];
+                ++iter;
             }
-            ++j;
         }
-        name_count_ = j;
     }
     else
     {
@@ -205,6 +243,12 @@ int service_manager::unregister_service(uint32_t svc_handle)
 
     wlock.unlock();
 
+    // tell the registrars (clusterd) the removed global names
+    for (auto& notify : gname_notify)
+    {
+        send(nullptr, svc_handle, notify.first, SERVICE_MSG_TYPE_TEXT, 0, (void*)notify.second.c_str(), notify.second.size());
+    }
+
      if (svc_ctx != nullptr)
      {
          // release service context may call skynet_handle_*, so wunlock first.
@@ -220,7 +264,7 @@ void service_manager::unregister_service_all()
     for (;;)
     {
         int n = 0;
-        for (int i = 0; i < svc_ctx_slot_size_; i++)
+        for (int i = 0; ; i++)
         {
             uint32_t svc_handle = 0;
 
@@ -228,7 +272,11 @@ void service_manager::unregister_service_all()
             {
                 std::shared_lock<std::shared_mutex> rlock(rw_mutex_);
 
-                service_context* svc_ctx = svc_ctx_slot_[i];
+                slot_table* table = slot_table_.load(std::memory_order_relaxed);
+                if (i >= table->size)
+                    break;
+
+                service_context* svc_ctx = table->slots[i].load(std::memory_order_relaxed);
                 if (svc_ctx != nullptr)
                 {
                     svc_handle = svc_ctx->svc_handle_;
@@ -261,63 +309,104 @@ void service_manager::process_blocked_service(uint32_t svc_handle)
 }
 
 // 取得一个服务 (增加服务引用计数)
+// lock free: the array and the context are not freed while pinned, the context may be released concurrently (ref count 0)
 service_context* service_manager::grab(uint32_t svc_handle)
 {
-    // read lock
-    std::shared_lock<std::shared_mutex> rlock(rw_mutex_);
+    epoch_guard guard;
 
-    uint32_t hash = svc_handle & (svc_ctx_slot_size_ - 1);
-    service_context* svc_ctx = svc_ctx_slot_[hash];
+    slot_table* table = slot_table_.load(std::memory_order_acquire);
+    uint32_t hash = svc_handle & (table->size - 1);
+    service_context* svc_ctx = table->slots[hash].load(std::memory_order_acquire);
     if (svc_ctx == nullptr || svc_ctx->svc_handle_ != svc_handle)
         return nullptr;
 
     //
-    svc_ctx->grab();
+    if (!svc_ctx->try_grab())
+        return nullptr;
 
     return svc_ctx;
 }
 
 // 通过name找handle
-// S->name是按handle_name->name升序排序的，通过二分查找快速地查找name对应的handle
 uint32_t service_manager::find_by_name(const char* svc_name)
 {
     // read lock
     std::shared_lock<std::shared_mutex> rlock(rw_mutex_);
 
-    uint32_t svc_handle = 0;
+    // service pool
+    if (pool_count_.load(std::memory_order_relaxed) > 0)
+    {
+        auto iter = pools_.find(svc_name);
+        if (iter != pools_.end())
+            return _pool_select(iter->second);
+    }
+
+    return _find_name(svc_name);
+}
 
-    int begin = 0;
-    int end = name_count_ - 1;
-    while (begin <= end)
+uint32_t service_manager::find_by_name(service_context* svc_ctx, const char* svc_name)
+{
+    if (svc_ctx == nullptr)
+        return find_by_name(svc_name);
+
+    _check_name_cache(svc_ctx);
+
+    uint32_t cached_handle = svc_ctx->name_cache_.find(svc_name);
+    if (cached_handle != 0)
+        return cached_handle;
+
+    // read lock
+    std::shared_lock<std::shared_mutex> rlock(rw_mutex_);
+
+    // service pool, routed per lookup (not cached)
+    if (pool_count_.load(std::memory_order_relaxed) > 0)
     {
-        int mid = (begin + end)/2;
-        handle_name* n = &name_[mid];
-        
-        int c = n->svc_name.compare(svc_name);
-        if (c == 0)
-        {
-            svc_handle = n->svc_handle;
-            break;
-        }
-        if (c < 0)
-        {
-            begin = mid + 1;
-        }
-        else
-        {
-            end = mid - 1;
-        }
+        auto iter = pools_.find(svc_name);
+        if (iter != pools_.end())
+            return _pool_select(iter->second);
     }
 
+    // not found is not cached, the name may be registered later
+    uint32_t svc_handle = _find_name(svc_name);
+    if (svc_handle != 0 && svc_ctx->name_cache_.size() < NAME_CACHE_MAX)
+        svc_ctx->name_cache_.insert(svc_name, svc_handle);
+
     return svc_handle;
 }
 
-// 给服务handle注册命名, 保证注册完s->name的有序
+void service_manager::_check_name_cache(service_context* svc_ctx)
+{
+    // a name is removed when its service exits, a global name is removed or rebound by clusterd, the generation changes.
+    // the invalidation is not per name: any named service exiting flushes the caches of all services, they refill on the next lookups.
+    // it's cheap when names belong to long-lived services, a named service that exits frequently (e.g. a named agent) defeats the caches.
+    uint64_t name_gen = name_gen_.load(std::memory_order_acquire);
+    if (svc_ctx->name_cache_gen_ != name_gen)
+    {
+        svc_ctx->name_cache_.clear();
+        svc_ctx->global_name_cache_.clear();
+        svc_ctx->name_cache_gen_ = name_gen;
+    }
+}
+
+uint32_t service_manager::_find_name(const char* svc_name)
+{
+    auto iter = names_.find(svc_name);
+    if (iter == names_.end())
+        return 0;
+
+    return iter->second;
+}
+
+// 给服务handle注册命名
 const char* service_manager::set_handle_by_name(const char* svc_name, uint32_t svc_handle)
 {
     // write lock
     std::unique_lock<std::shared_mutex> wlock(rw_mutex_);
 
+    // name is used by a service pool
+    if (pools_.find(svc_name) != pools_.end())
+        return nullptr;
+
     return _insert_name(svc_name, svc_handle);
 }
 
@@ -331,15 +420,208 @@ uint32_t service_manager::query_by_name(service_context* svc_ctx, const char* na
     // local service
     else if (name_or_addr[0] == '.')
     {
-        return find_by_name(name_or_addr + 1);
+        return find_by_name(svc_ctx, name_or_addr + 1);
     }
     // global service
     else
     {
-        // not support query global service, just log a message
-        log_error(svc_ctx, fmt::format("Don't support query global name {}", name_or_addr));
+        return find_global_name(svc_ctx, name_or_addr);
+    }
+}
+
+bool service_manager::set_global_name(const char* svc_name, uint32_t svc_handle, uint64_t version, uint32_t registrar)
+{
+    // write lock
+    std::unique_lock<std::shared_mutex> wlock(rw_mutex_);
+
+    global_name& gname = global_names_[svc_name];
+    if (gname.version != 0 && version <= gname.version)
+        return false;
+
+    // rebound or removed, invalidate the name caches (missing names are not cached, a new name needs nothing)
+    if (gname.svc_handle != 0 && gname.svc_handle != svc_handle)
+        name_gen_.fetch_add(1, std::memory_order_release);
+
+    // keep the removed name (svc_handle 0) with its version, a stale update can't bring it back
+    gname.svc_handle = svc_handle;
+    gname.version = version;
+    gname.registrar = registrar;
+
+    return true;
+}
+
+uint32_t service_manager::find_global_name(service_context* svc_ctx, const char* svc_name)
+{
+    if (svc_ctx != nullptr)
+    {
+        _check_name_cache(svc_ctx);
+
+        uint32_t cached_handle = svc_ctx->global_name_cache_.find(svc_name);
+        if (cached_handle != 0)
+            return cached_handle;
+    }
+
+    uint32_t svc_handle = 0;
+
+    // read scope lock
+    {
+        std::shared_lock<std::shared_mutex> rlock(rw_mutex_);
+
+        auto iter = global_names_.find(svc_name);
+        if (iter != global_names_.end())
+            svc_handle = iter->second.svc_handle;
+    }
+
+    if (svc_ctx != nullptr && svc_handle != 0 && svc_ctx->global_name_cache_.size() < NAME_CACHE_MAX)
+        svc_ctx->global_name_cache_.insert(svc_name, svc_handle);
+
+    return svc_handle;
+}
+
+bool service_manager::pool_join(const char* pool_name, uint32_t svc_handle, int route)
+{
+    // write lock
+    std::unique_lock<std::shared_mutex> wlock(rw_mutex_);
+
+    // name is used by a service
+    if (_find_name(pool_name) != 0)
+        return false;
+
+    auto iter = pools_.find(pool_name);
+    if (iter == pools_.end())
+    {
+        iter = pools_.emplace(std::piecewise_construct, std::forward_as_tuple(pool_name), std::forward_as_tuple()).first;
+        ++pool_count_;
+    }
+
+    service_pool& pool = iter->second;
+    pool.route = route;
+    if (std::find(pool.svc_handles.begin(), pool.svc_handles.end(), svc_handle) == pool.svc_handles.end())
+    {
+        pool.svc_handles.push_back(svc_handle);
+    }
+
+    return true;
+}
+
+void service_manager::pool_leave(const char* pool_name, uint32_t svc_handle)
+{
+    // write lock
+    std::unique_lock<std::shared_mutex> wlock(rw_mutex_);
+
+    auto iter = pools_.find(pool_name);
+    if (iter == pools_.end())
+        return;
+
+    auto& members = iter->second.svc_handles;
+    members.erase(std::remove(members.begin(), members.end(), svc_handle), members.end());
+    if (members.empty())
+    {
+        pools_.erase(iter);
+        --pool_count_;
+    }
+}
+
+uint32_t service_manager::pool_select(const char* pool_name)
+{
+    if (pool_count_.load(std::memory_order_relaxed) == 0)
+        return 0;
+
+    // read lock
+    std::shared_lock<std::shared_mutex> rlock(rw_mutex_);
+
+    auto iter = pools_.find(pool_name);
+    if (iter == pools_.end())
+        return 0;
+
+    return _pool_select(iter->second);
+}
+
+// jump consistent hash (Lamping & Veach), few keys move when a member is appended
+static int _jump_hash(uint64_t key, int buckets)
+{
+    int64_t b = -1;
+    int64_t j = 0;
+    while (j < buckets)
+    {
+        b = j;
+        key = key * 2862933555777941757ULL + 1;
+        j = (int64_t)((b + 1) * ((double)(1LL << 31) / (double)((key >> 33) + 1)));
+    }
+
+    return (int)b;
+}
+
+uint32_t service_manager::pool_select_sticky(const char* pool_name, uint64_t key)
+{
+    if (pool_count_.load(std::memory_order_relaxed) == 0)
         return 0;
+
+    // read lock
+    std::shared_lock<std::shared_mutex> rlock(rw_mutex_);
+
+    auto iter = pools_.find(pool_name);
+    if (iter == pools_.end())
+        return 0;
+
+    auto& members = iter->second.svc_handles;
+    return members[_jump_hash(key, (int)members.size())];
+}
+
+bool service_manager::pool_members(const char* pool_name, std::vector<uint32_t>& svc_handles)
+{
+    // read lock
+    std::shared_lock<std::shared_mutex> rlock(rw_mutex_);
+
+    auto iter = pools_.find(pool_name);
+    if (iter == pools_.end())
+        return false;
+
+    svc_handles = iter->second.svc_handles;
+    return true;
+}
+
+uint32_t service_manager::_pool_select(service_pool& pool)
+{
+    int n = (int)pool.svc_handles.size();
+    int start = (int)(pool.cursor.load(std::memory_order_relaxed) % n);
+
+    // the members are alive (registered) while holding the lock
+    slot_table* table = slot_table_.load(std::memory_order_relaxed);
+    uint32_t best_handle = 0;
+    uint64_t best_load = UINT64_MAX;
+    int best_idx = start;
+    for (int i = 0; i < n; i++)
+    {
+        int idx = (start + i) % n;
+        uint32_t svc_handle = pool.svc_handles[idx];
+        service_context* svc_ctx = table->slots[svc_handle & (table->size - 1)].load(std::memory_order_relaxed);
+        if (svc_ctx == nullptr || svc_ctx->svc_handle_ != svc_handle)
+            continue;
+
+        uint64_t length = (uint64_t)svc_ctx->queue_->length();
+        uint64_t load = length;
+        if (pool.route == POOL_ROUTE_SOJOURN)
+        {
+            // predicted sojourn time: recent sojourn, plus the messages queued after it (the recent sojourn is only updated on dequeue,
+            // without the queued part, all lookups in a burst go to the same member). idle member waits nothing.
+            load = length == 0 ? 0 : svc_ctx->queue_->codel_.recent_sojourn() + length * (svc_ctx->message_cost_.load(std::memory_order_relaxed) + 1);
+        }
+
+        if (load < best_load)
+        {
+            best_load = load;
+            best_handle = svc_handle;
+            best_idx = idx;
+            if (load == 0)
+                break;
+        }
     }
+
+    // next scan starts after the selected one, round robin among the equally loaded members
+    pool.cursor.store((uint32_t)(best_idx + 1), std::memory_order_relaxed);
+
+    return best_handle;
 }
 
 // 投递服务消息
@@ -358,69 +640,68 @@ int service_manager::push_service_message(uint32_t svc_handle, service_message*
     return 0;
 }
 
-// 
-const char* service_manager::_insert_name(const char* svc_name, uint32_t svc_handle)
+bool service_manager::pressure(uint32_t svc_handle, int& length, int& capacity)
 {
-    int begin = 0;
-    int end = name_count_ - 1;
-    while (begin <= end)
-    {
-        int mid = (begin + end) / 2;
-        handle_name* n = &name_[mid];
+    service_context* svc_ctx = grab(svc_handle);
+    if (svc_ctx == nullptr)
+        return false;
 
-        int c = n->svc_name.compare(svc_name);
-        // exists
-        if (c == 0)
-            return nullptr;
+    length = svc_ctx->queue_->lane_length(mq_private::LANE_NORMAL);
+    capacity = svc_ctx->queue_->capacity();
+    release_service(svc_ctx);
 
-        if (c < 0)
-        {
-            begin = mid + 1;
-        }
-        else
-        {
-            end = mid - 1;
-        }
-    }
+    return true;
+}
 
-    return _insert_name_before(svc_name, svc_handle, begin);
+int service_manager::call_inbound(uint32_t svc_handle)
+{
+    service_context* svc_ctx = grab(svc_handle);
+    if (svc_ctx == nullptr)
+        return -1;
+
+    int count = svc_ctx->call_inbound_->load(std::memory_order_relaxed);
+    release_service(svc_ctx);
+
+    return count;
 }
 
-// 把name插入到name数组中，再关联handle
-const char* service_manager::_insert_name_before(const char* svc_name, uint32_t svc_handle, int before)
+int service_manager::_push_bounded(service_context* svc_ctx, uint32_t dst_svc_handle, service_message* message, bool is_call)
 {
-    if (name_count_ >= name_cap_)
+    service_context* dst_svc_ctx = grab(dst_svc_handle);
+    if (dst_svc_ctx == nullptr)
+        return -1;
+
+    int result = dst_svc_ctx->queue_->push_bounded(message);
+    if (is_call && result != mq_private::PUSH_REJECT)
     {
-        name_cap_ *= 2;
-        assert(name_cap_ <= MAX_SLOT_SIZE);
+        svc_ctx->sessions_.track(svc_ctx->svc_handle_, message->session_id, dst_svc_ctx);
+    }
+    release_service(dst_svc_ctx);
 
-        handle_name* n = new handle_name[name_cap_];
-        for (int i = 0; i < before; i++)
-        {
-            n[i] = name_[i];
-        }
-        for (int i = before; i < name_count_; i++)
-        {
-            n[i+1] = name_[i];
-        }
+    if (result == mq_private::PUSH_REJECT)
+        return -3;
 
-        delete[] name_;
-        name_ = n;
-    }
-    else
+    // signal the sender to throttle
+    if (result == mq_private::PUSH_THROTTLE && svc_ctx != nullptr)
     {
-        for (int i = name_count_; i > before; i--)
-        {
-            name_[i] = name_[i-1];
-        }
+        svc_ctx->is_send_throttled_ = true;
     }
-    name_[before].svc_name = svc_name;
-    name_[before].svc_handle = svc_handle;
-    ++name_count_;
 
-    return name_[before].svc_name.c_str();
+    return 0;
 }
 
+// 
+const char* service_manager::_insert_name(const char* svc_name, uint32_t svc_handle)
+{
+    auto result = names_.emplace(svc_name, svc_handle);
+    // exists
+    if (!result.second)
+        return nullptr;
+
+    handle_names_[svc_handle].push_back(svc_name);
+
+    return result.first->first.c_str();
+}
 
 // release service context
 service_context* service_manager::release_service(service_context* svc_ctx)
@@ -436,7 +717,8 @@ service_context* service_manager::release_service(service_context* svc_ctx)
         svc_ctx->svc_mod_ptr_->release_func_(svc_ctx->svc_ptr_);
         svc_ctx->queue_->mark_release();
 
-        delete svc_ctx;
+        // a lock free grab() may still read the context
+        epoch::instance()->retire(svc_ctx, _delete_service);
         --svc_count_;
 
         return nullptr;
@@ -445,18 +727,91 @@ service_context* service_manager::release_service(service_context* svc_ctx)
     return svc_ctx;
 }
 
-// 发送消息
-// ctx之间通过消息进行通信，调用skynet_send向对方发送消息(skynet_sendname最终也会调用skynet_send)。
-// @param svc_ctx            源服务的ctx，可以为NULL，drop_message时这个参数为NULL
-// @param src_svc_handle         源服务地址，通常设置为0即可，api里会设置成ctx->handle，当context为NULL时，需指定source
-// @param dst_svc_handle     目的服务地址
-// @param svc_msg_type             消息类型， skynet定义了多种消息，SERVICE_MSG_TYPE_TEXT，SERVICE_MSG_TYPE_CLIENT，SERVICE_MSG_TYPE_RESPONSE等（详情见skynet.h）
-// @param session         如果在type里设上allocsession的tag(MESSAGE_TAG_ALLOC_SESSION)，api会忽略掉传入的session参数，重新生成一个新的唯一的
-// @param msg             消息包数据
-// @param msg_sz             消息包长度
-// @return int session, 源服务保存这个session，同时约定，目的服务处理完这个消息后，把这个session原样发送回来(skynet_message结构里带有一个session字段)，
-//         源服务就知道是哪个请求的返回，从而正确调用对应的回调函数。
-int service_manager::send(service_context* svc_ctx, uint32_t src_svc_handle, uint32_t dst_svc_handle , int svc_msg_type, int session_id, void* msg, size_t msg_sz)
+void service_manager::stat_all(std::vector<service_stat>& stats)
+{
+    epoch_guard guard;
+
+    slot_table* table = slot_table_.load(std::memory_order_acquire);
+    stats.reserve(stats.size() + svc_count_.load(std::memory_order_relaxed));
+    for (int i = 0; i < table->size; i++)
+    {
+        // keep the context (and its mailbox) alive while reading
+        service_context* svc_ctx = table->slots[i].load(std::memory_order_acquire);
+        if (svc_ctx == nullptr || !svc_ctx->try_grab())
+            continue;
+
+        mq_private* q = svc_ctx->queue_;
+        if (q != nullptr)
+        {
+            service_stat stat;
+            stat.svc_handle = svc_ctx->svc_handle_;
+            stat.message_count = svc_ctx->message_count_.load(std::memory_order_relaxed);
+            stat.cpu_cost = svc_ctx->cpu_cost_.load(std::memory_order_relaxed);
+            stat.mqlen = q->length();
+            stat.overload_count = q->overload_count_.load(std::memory_order_relaxed);
+            stat.mem = svc_ctx->mem_usage_.load(std::memory_order_relaxed);
+            stats.push_back(stat);
+        }
+
+        release_service(svc_ctx);
+    }
+}
+
+service_manager::slot_table* service_manager::_new_slot_table(int size)
+{
+    slot_table* table = new slot_table;
+    table->size = size;
+    table->slots = new std::atomic<service_context*>[size];
+    for (int i = 0; i < size; i++)
+        table->slots[i].store(nullptr, std::memory_order_relaxed);
+
+    return table;
+}
+
+void service_manager::_delete_slot_table(void* ptr)
+{
+    slot_table* table = static_cast<slot_table*>(ptr);
+    delete[] table->slots;
+    delete table;
+}
+
+void service_manager::_delete_service(void* ptr)
+{
+    service_context* svc_ctx = static_cast<service_context*>(ptr);
+
+    // reset to a new context (release the outstanding calls, caches), keep the memory
+    svc_ctx->~service_context();
+    new (svc_ctx) service_context;
+
+    service_manager* mgr = instance();
+    {
+        std::lock_guard<std::mutex> lock(mgr->free_ctx_mutex_);
+        if (mgr->free_ctxs_.size() < FREE_CTX_MAX)
+        {
+            mgr->free_ctxs_.push_back(svc_ctx);
+            return;
+        }
+    }
+
+    delete svc_ctx;
+}
+
+service_context* service_manager::_new_service()
+{
+    {
+        std::lock_guard<std::mutex> lock(free_ctx_mutex_);
+        if (!free_ctxs_.empty())
+        {
+            service_context* svc_ctx = free_ctxs_.back();
+            free_ctxs_.pop_back();
+            return svc_ctx;
+        }
+    }
+
+    return new service_context;
+}
+
+int service_manager::_prepare_message(service_context* svc_ctx, uint32_t src_svc_handle, uint32_t dst_svc_handle, int svc_msg_type, int session_id, void* msg, size_t msg_sz, service_message* smsg)
 {
     if ((msg_sz & MESSAGE_TYPE_MASK) != msg_sz)
     {
@@ -482,40 +837,82 @@ int service_manager::send(service_context* svc_ctx, uint32_t src_svc_handle, uin
         assert(session_id == 0);
         session_id = svc_ctx->new_session();
     }
-    if (need_copy && msg != nullptr)
-    {
-        char* new_msg = new char[msg_sz + 1];
-        ::memcpy(new_msg, msg, msg_sz);
-        new_msg[msg_sz] = '\0';
-        msg = new_msg;
-    }
-    msg_sz |= (size_t)svc_msg_type << MESSAGE_TYPE_SHIFT;
 
     if (dst_svc_handle == 0)
     {
         if (msg != nullptr)
         {
             log_error(svc_ctx, "Destination service handle can't be 0");
-            delete[] msg;
+            if (!need_copy)
+            {
+                delete[] msg;
+            }
             return -1;
         }
 
         return session_id;
     }
 
+    // small message, store the payload in the message (the payload of don't copy message is released here)
+    smsg->is_inline = false;
+    if (msg != nullptr && msg_sz < MESSAGE_INLINE_SIZE)
+    {
+        ::memcpy(smsg->inline_data, msg, msg_sz);
+        smsg->inline_data[msg_sz] = '\0';
+        smsg->is_inline = true;
+        if (!need_copy)
+        {
+            delete[] msg;
+        }
+        msg = nullptr;
+    }
+    else if (need_copy && msg != nullptr)
+    {
+        char* new_msg = new char[msg_sz + 1];
+        ::memcpy(new_msg, msg, msg_sz);
+        new_msg[msg_sz] = '\0';
+        msg = new_msg;
+    }
+    msg_sz |= (size_t)svc_msg_type << MESSAGE_TYPE_SHIFT;
+
     if (src_svc_handle == 0)
         src_svc_handle = svc_ctx->svc_handle_;
 
-    // push message to dst service
+    smsg->src_svc_handle = src_svc_handle;
+    smsg->session_id = session_id;
+    smsg->data_ptr = msg;
+    smsg->data_size = msg_sz;
+
+    return session_id;
+}
+
+// 发送消息
+// ctx之间通过消息进行通信，调用skynet_send向对方发送消息(skynet_sendname最终也会调用skynet_send)。
+// @param svc_ctx            源服务的ctx，可以为NULL，drop_message时这个参数为NULL
+// @param src_svc_handle         源服务地址，通常设置为0即可，api里会设置成ctx->handle，当context为NULL时，需指定source
+// @param dst_svc_handle     目的服务地址
+// @param svc_msg_type             消息类型， skynet定义了多种消息，SERVICE_MSG_TYPE_TEXT，SERVICE_MSG_TYPE_CLIENT，SERVICE_MSG_TYPE_RESPONSE等（详情见skynet.h）
+// @param session         如果在type里设上allocsession的tag(MESSAGE_TAG_ALLOC_SESSION)，api会忽略掉传入的session参数，重新生成一个新的唯一的
+// @param msg             消息包数据
+// @param msg_sz             消息包长度
+// @return int session, 源服务保存这个session，同时约定，目的服务处理完这个消息后，把这个session原样发送回来(skynet_message结构里带有一个session字段)，
+//         源服务就知道是哪个请求的返回，从而正确调用对应的回调函数。
+int service_manager::send(service_context* svc_ctx, uint32_t src_svc_handle, uint32_t dst_svc_handle , int svc_msg_type, int session_id, void* msg, size_t msg_sz)
+{
+    // a call (request with an allocated session) is tracked until its response
+    bool is_call = svc_ctx != nullptr && (svc_msg_type & MESSAGE_TAG_ALLOC_SESSION) != 0;
+
     service_message smsg;
-    smsg.src_svc_handle = src_svc_handle;
-    smsg.session_id = session_id;
-    smsg.data_ptr = msg;
-    smsg.data_size = msg_sz;
-    if (push_service_message(dst_svc_handle, &smsg))
+    session_id = _prepare_message(svc_ctx, src_svc_handle, dst_svc_handle, svc_msg_type, session_id, msg, msg_sz, &smsg);
+    if (session_id < 0 || dst_svc_handle == 0)
+        return session_id;
+
+    // push message to dst service (bounded mailbox)
+    int result = _push_bounded(svc_ctx, dst_svc_handle, &smsg, is_call);
+    if (result < 0)
     {
-        delete[] msg;
-        return -1;
+        delete[] smsg.data_ptr;
+        return result;
     }
 
     return session_id;
@@ -532,10 +929,13 @@ int service_manager::send_by_name(service_context* svc_ctx, uint32_t src_svc_han
     {
         des = ::strtoul(dst_name_or_addr + 1, nullptr, 16);
     }
-    // local service
-    else if (dst_name_or_addr[0] == '.')
+    // local service, or global service
+    else
     {
-        des = find_by_name(dst_name_or_addr + 1);
+        if (dst_name_or_addr[0] == '.')
+            des = find_by_name(svc_ctx, dst_name_or_addr + 1);
+        else
+            des = find_global_name(svc_ctx, dst_name_or_addr);
         if (des == 0)
         {
             if (svc_msg_type & MESSAGE_TAG_DONT_COPY)
@@ -549,4 +949,95 @@ int service_manager::send_by_name(service_context* svc_ctx, uint32_t src_svc_han
     return send(svc_ctx, src_svc_handle, des, svc_msg_type, session, msg, sz);
 }
 
+int service_manager::send_batch(service_context* svc_ctx, uint32_t src_svc_handle, std::vector<send_item>& items)
+{
+    // prepare messages
+    std::vector<service_message> messages(items.size());
+    std::vector<int> order;
+    std::vector<bool> is_calls(items.size(), false);
+    order.reserve(items.size());
+    for (size_t i = 0; i < items.size(); i++)
+    {
+        send_item& item = items[i];
+        is_calls[i] = svc_ctx != nullptr && (item.svc_msg_type & MESSAGE_TAG_ALLOC_SESSION) != 0;
+        item.session_id = _prepare_message(svc_ctx, src_svc_handle, item.dst_svc_handle, item.svc_msg_type, item.session_id, item.msg, item.msg_sz, &messages[i]);
+        if (item.session_id >= 0 && item.dst_svc_handle != 0)
+            order.push_back(i);
+    }
+
+    // group by destination (keep the order of messages to the same destination)
+    std::stable_sort(order.begin(), order.end(), [&items](int a, int b) {
+        return items[a].dst_svc_handle < items[b].dst_svc_handle;
+    });
+
+    int sent = 0;
+    std::vector<service_message> group;
+    for (size_t begin = 0; begin < order.size();)
+    {
+        uint32_t dst_svc_handle = items[order[begin]].dst_svc_handle;
+        size_t end = begin;
+        group.clear();
+        while (end < order.size() && items[order[end]].dst_svc_handle == dst_svc_handle)
+        {
+            group.push_back(messages[order[end]]);
+            ++end;
+        }
+
+        // one grab and one mailbox handoff per destination
+        service_context* dst_svc_ctx = grab(dst_svc_handle);
+        if (dst_svc_ctx != nullptr && dst_svc_ctx->queue_->capacity() == 0)
+        {
+            dst_svc_ctx->queue_->push_batch(group.data(), (int)group.size());
+            sent += (int)group.size();
+            for (size_t i = begin; i < end; i++)
+            {
+                if (is_calls[order[i]])
+                {
+                    svc_ctx->sessions_.track(svc_ctx->svc_handle_, items[order[i]].session_id, dst_svc_ctx);
+                }
+            }
+        }
+        // bounded mailbox, check each message
+        else if (dst_svc_ctx != nullptr)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                int result = dst_svc_ctx->queue_->push_bounded(&messages[order[i]]);
+                if (result == mq_private::PUSH_REJECT)
+                {
+                    delete[] messages[order[i]].data_ptr;
+                    items[order[i]].session_id = -3;
+                    continue;
+                }
+                if (result == mq_private::PUSH_THROTTLE && svc_ctx != nullptr)
+                {
+                    svc_ctx->is_send_throttled_ = true;
+                }
+                if (is_calls[order[i]])
+                {
+                    svc_ctx->sessions_.track(svc_ctx->svc_handle_, items[order[i]].session_id, dst_svc_ctx);
+                }
+                ++sent;
+            }
+        }
+        else
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                delete[] messages[order[i]].data_ptr;
+                items[order[i]].session_id = -1;
+            }
+        }
+        if (dst_svc_ctx != nullptr)
+        {
+            release_service(dst_svc_ctx);
+        }
+
+        begin = end;
+    }
+
+    return sent;
+}
+
+
 }
@@ -2,7 +2,11 @@
 
 #include <cstdint>
 #include <shared_mutex>
+#include <mutex>
 #include <atomic>
+#include <string>
+#include <vector>
+#include <unordered_map>
 
 namespace skynet {
 
@@ -14,10 +18,17 @@ class service_context;
  * skynet node service manager
  * 1) store all service context
  * 2) generate service handle
+ * 3) grab() is lock free: the service context array is read under an epoch pin (see utils/epoch.h), the writers
+ *    (register, unregister, naming) are serialized by rw_mutex_, a replaced array and a released service context are
+ *    retired by epoch, freed after the readers leave.
  *
  * service handle specs:
  * 1) 0 is reserved
  * 2) count start of 1
+ *
+ * service pool: many instances of the same service share one local name, find_by_name() (and send by name) routes each
+ * lookup to the least loaded member (shortest queue, or lowest recent sojourn time), pool_select_sticky() maps a key
+ * to a fixed member for ordered streams.
  */
 class service_manager
 {
@@ -32,13 +43,60 @@ private:
     {
         DEFAULT_SLOT_SIZE = 4,                              // default service context array size
         MAX_SLOT_SIZE = 0x40000000,                         // max service context array size
+        NAME_CACHE_MAX = 256,                               // max names cached per service
+        FREE_CTX_MAX = 1024,                                // max service contexts kept for reuse
+    };
+
+    // service pool
+    struct service_pool
+    {
+        std::vector<uint32_t> svc_handles;                  // member service handles
+        int route = 0;                                      // pool_route
+        std::atomic<uint32_t> cursor { 0 };                 // scan start, spread the lookups when members are equally loaded
+    };
+
+    // global name (replicated by clusterd, see service/clusterd.lua)
+    struct global_name
+    {
+        uint32_t svc_handle = 0;                            // local address: the service, or the proxy of a remote service. 0: removed
+        uint64_t version = 0;                               // update version (cluster wide order)
+        uint32_t registrar = 0;                             // the service applied the update (clusterd), told when the service of the name exits
+    };
+
+    // service context array, replaced (not resized) when growing, the old one is retired by epoch
+    struct slot_table
+    {
+        int size = 0;                                       // array size (2^n)
+        std::atomic<service_context*>* slots = nullptr;     // service context array
+    };
+
+public:
+    // service pool route policies
+    enum pool_route
+    {
+        POOL_ROUTE_LENGTH = 0,                              // shortest message queue
+        POOL_ROUTE_SOJOURN = 1,                             // lowest predicted sojourn time (queue waiting time)
+    };
+
+    // service runtime stat (see stat_all)
+    struct service_stat
+    {
+        uint32_t svc_handle = 0;                            //
+        int message_count = 0;                              // messages dispatched
+        uint64_t cpu_cost = 0;                              // cpu time (microsec), 0 if profile is off (and no cpu quota)
+        int mqlen = 0;                                      // mailbox length
+        uint64_t overload_count = 0;                        // times the mailbox length crossed the overload threshold
+        uint64_t mem = 0;                                   // module memory (bytes, snlua: lua vm), 0: unknown
     };
 
-    // service handle naming (corresponding relationship between handle and name)
-    struct handle_name
+    // batch send item
+    struct send_item
     {
-        std::string svc_name = "";                          // service name
-        uint32_t svc_handle = 0;                            // service handle
+        uint32_t dst_svc_handle = 0;                        // destination service handle
+        int svc_msg_type = 0;                               // message type (with message tag)
+        int session_id = 0;                                 // session id, the result session id (or < 0 if failed) after send_batch()
+        void* msg = nullptr;                                // message data
+        size_t msg_sz = 0;                                  // message data size
     };
 
 private:
@@ -46,26 +104,37 @@ private:
 
     // service context data
     uint32_t alloc_svc_handle_seed_ = 1;                    // service handle seed, used to alloc service handle (count start of 1, 0 is reserved)
-    int svc_ctx_slot_size_ = DEFAULT_SLOT_SIZE;             // service context array size (2^n, initialize is 4)
-    service_context** svc_ctx_slot_ = nullptr;              // service context array
+    std::atomic<slot_table*> slot_table_ { nullptr };       // service context array (grab() reads it without lock)
 
     // service naming (register a name for service handle, name can be more than one)
-    int name_cap_ = 2;                                      // service alias name list capacity (2^n)
-    int name_count_ = 0;                                    // number of service alias name in service alias name list.
-    handle_name* name_ = nullptr;                           // service alias name list (sort by svc_name, because find_by_name() use binary search)
+    std::unordered_map<std::string, uint32_t> names_;       // service name -> service handle
+    std::unordered_map<uint32_t, std::vector<std::string>> handle_names_; // service handle -> service names, remove names when the service exits
+    std::atomic<uint64_t> name_gen_ { 0 };                  // name registry generation, changed when a name is removed or rebound (flush all the name caches, see _check_name_cache)
+
+    // global name directory, a read-only replica of the cluster directory (updated by clusterd)
+    std::unordered_map<std::string, global_name> global_names_; //
+
+    // service pools (pool name -> members)
+    std::unordered_map<std::string, service_pool> pools_;   //
+    std::atomic<int> pool_count_ { 0 };                     // number of pools, skip the pool lookup if 0
 
     std::atomic<int> svc_count_ { 0 };                   // service context count in this skynet node
 
+    // recycled service contexts (service churn), the mailboxes are recycled by mq_private
+    std::mutex free_ctx_mutex_;                             //
+    std::vector<service_context*> free_ctxs_;               //
+
 public:
     // initialize service context manager
     bool init();
     void fini();
 
 public:
-    service_context* create_service(const char* svc_name, const char* svc_args);
+    // create service, is_exclusive: the service run in its own thread (see node_exclusive)
+    service_context* create_service(const char* svc_name, const char* svc_args, bool is_exclusive = false);
     service_context* release_service(service_context* svc_ctx);
 
-    // register service context, return service handle
+    // register service context, set and return service handle
     uint32_t register_service(service_context* svc_ctx);
     int unregister_service(uint32_t svc_handle);
     void unregister_service_all();
@@ -76,20 +145,50 @@ public:
     // grab a service by service handle
     service_context* grab(uint32_t svc_handle);
 
-    // find service handle by service name (binary search)
+    // find service handle by service name, a pool name returns the least loaded member
     uint32_t find_by_name(const char* svc_name);
-    // set service handle alias (sort by svc_name, because find_by_name() use binary search)
+    // find by the name cache of svc_ctx (owner thread only) first, the resolved names (not pools) are cached
+    // until the name registry generation changes
+    uint32_t find_by_name(service_context* svc_ctx, const char* svc_name);
+    // set service handle alias, return nullptr if the name exists
     const char* set_handle_by_name(const char* svc_name, uint32_t svc_handle);
 
     // query by service name or service address string, return service handle
     uint32_t query_by_name(service_context* svc_ctx, const char* name_or_addr);
 
+    // apply a global name update (replicated by clusterd), svc_handle: local address, 0: removed
+    // return false if the update is stale (version is not newer)
+    // when the service of the name exits, the name is removed and the registrar gets a text message (source: the exited service, data: the name)
+    bool set_global_name(const char* svc_name, uint32_t svc_handle, uint64_t version, uint32_t registrar = 0);
+    // find a global name, by the name cache of svc_ctx (owner thread only) first, return 0 if not exists
+    uint32_t find_global_name(service_context* svc_ctx, const char* svc_name);
+
+    // join a service pool (created if not exists), route: pool_route (set for the whole pool)
+    // return false if the name is used by a service (not a pool)
+    bool pool_join(const char* pool_name, uint32_t svc_handle, int route);
+    // leave a service pool (the pool is removed when empty)
+    void pool_leave(const char* pool_name, uint32_t svc_handle);
+    // the least loaded member of a pool, return 0 if the pool not exists
+    uint32_t pool_select(const char* pool_name);
+    // the member for a key (same key, same member while the members are unchanged), return 0 if the pool not exists
+    uint32_t pool_select_sticky(const char* pool_name, uint64_t key);
+    // pool members, return false if the pool not exists
+    bool pool_members(const char* pool_name, std::vector<uint32_t>& svc_handles);
+
     //
     int svc_count();
 
+    // snapshot the runtime stat of all services, read from the counters maintained by the services and their mailboxes
+    // (no message to the services, lock free walk of the service table)
+    void stat_all(std::vector<service_stat>& stats);
+
 public:
     // push service message
     int push_service_message(uint32_t svc_handle, service_message* message);
+    // query the mailbox pressure of a service: pending messages (normal lane) and capacity (0: unlimited), return false if service not exists
+    bool pressure(uint32_t svc_handle, int& length, int& capacity);
+    // query the outstanding calls to a service (sent and not responded or expired), return -1 if service not exists
+    int call_inbound(uint32_t svc_handle);
 
     //
     // @param src_svc_handle 0: reserve service handle, self
@@ -98,6 +197,8 @@ public:
     // @param session 每个服务仅有一个callback函数, 所以需要一个标识来区分消息包, 这就是session的作用
     //                可以在 svc_msg_type 里设上 alloc session 的 tag (MESSAGE_TAG_ALLOC_SESSION), send api 就会忽略掉传入的 session 参数，而会分配出一个当前服务从来没有使用过的 session 号，发送出去。
     //                同时约定，接收方在处理完这个消息后，把这个 session 原样发送回来。这样，编写服务的人只需要在 callback 函数里记录下所有待返回的 session 表，就可以在收到每个消息后，正确的调用对应的处理函数。
+    // @return session id, < 0 failed: -1 invalid destination, -2 message is too large, -3 destination mailbox is full
+    //         if the destination mailbox is full and its policy is throttle, the message is sent and svc_ctx->is_send_throttled_ is set.
     int send(service_context* svc_ctx, uint32_t src_svc_handle, uint32_t dst_svc_handle, int svc_msg_type, int session_id, void* msg, size_t msg_sz);
 
     /**
@@ -113,11 +214,42 @@ public:
      */
     int send_by_name(service_context* svc_ctx, uint32_t src_svc_handle, const char* dst_name_or_addr, int svc_msg_type, int session, void* msg, size_t msg_sz);
 
+    /**
+     * send messages in batch, messages are grouped per destination service (one grab and one mailbox handoff per destination).
+     * the order of messages to the same destination is kept.
+     *
+     * @param svc_ctx
+     * @param src_svc_handle 0: reserve service handle, self
+     * @param items send items, same as send() arguments, session_id is set to the result of each message
+     * @return the number of messages sent
+     */
+    int send_batch(service_context* svc_ctx, uint32_t src_svc_handle, std::vector<send_item>& items);
+
 private:
-    //
+    // push a service message with mailbox capacity check, return 0 success, -1 service not exists, -3 mailbox is full
+    // is_call: the message is a call, count it as an outstanding call of the destination
+    int _push_bounded(service_context* svc_ctx, uint32_t dst_svc_handle, service_message* message, bool is_call = false);
+    // check message size, alloc session, copy message data, and fill the service message. return session id (< 0 failed)
+    int _prepare_message(service_context* svc_ctx, uint32_t src_svc_handle, uint32_t dst_svc_handle, int svc_msg_type, int session_id, void* msg, size_t msg_sz, service_message* smsg);
+
+    // find service handle by service name (lock by caller)
+    uint32_t _find_name(const char* svc_name);
+    // clear the name caches of svc_ctx if the name registry generation changed
+    void _check_name_cache(service_context* svc_ctx);
+    // least loaded member of a pool (lock by caller)
+    uint32_t _pool_select(service_pool& pool);
+
+    // alloc a service context array
+    static slot_table* _new_slot_table(int size);
+    // epoch deleters
+    static void _delete_slot_table(void* ptr);
+    // reset the service context and keep it for reuse, or delete it
+    static void _delete_service(void* ptr);
+    // alloc a service context, reuse a recycled one first
+    service_context* _new_service();
+
+    // insert a name (lock by caller), return nullptr if the name exists
     const char* _insert_name(const char* svc_name, uint32_t svc_handle);
-    // 把name插入到name数组中，再关联handle
-    const char* _insert_name_before(const char* svc_name, uint32_t svc_handle, int before);
 };
 
 }
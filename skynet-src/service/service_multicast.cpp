@@ -0,0 +1,162 @@
+#include "service_multicast.h"
+#include "service_manager.h"
+
+#include "../mq/mq_msg.h"
+
+#include <mutex>
+#include <algorithm>
+
+namespace skynet {
+
+service_multicast* service_multicast::instance_ = nullptr;
+std::atomic<int> service_multicast::package_count_ { 0 };
+
+service_multicast* service_multicast::instance()
+{
+    static std::once_flag oc;
+    std::call_once(oc, [&](){ instance_ = new service_multicast; });
+
+    return instance_;
+}
+
+uint32_t service_multicast::new_channel()
+{
+    std::unique_lock<std::shared_mutex> wlock(rw_mutex_);
+
+    // 0 is reserved
+    uint32_t channel = ++channel_seed_;
+    while (channel == 0 || channels_.find(channel) != channels_.end())
+    {
+        channel = ++channel_seed_;
+    }
+    channels_[channel];
+
+    return channel;
+}
+
+bool service_multicast::delete_channel(uint32_t channel)
+{
+    std::unique_lock<std::shared_mutex> wlock(rw_mutex_);
+
+    return channels_.erase(channel) != 0;
+}
+
+bool service_multicast::subscribe(uint32_t channel, uint32_t svc_handle)
+{
+    std::unique_lock<std::shared_mutex> wlock(rw_mutex_);
+
+    auto itr_find = channels_.find(channel);
+    if (itr_find == channels_.end())
+        return false;
+
+    auto& subscribers = itr_find->second;
+    if (std::find(subscribers.begin(), subscribers.end(), svc_handle) == subscribers.end())
+    {
+        subscribers.push_back(svc_handle);
+    }
+
+    return true;
+}
+
+bool service_multicast::unsubscribe(uint32_t channel, uint32_t svc_handle)
+{
+    std::unique_lock<std::shared_mutex> wlock(rw_mutex_);
+
+    auto itr_find = channels_.find(channel);
+    if (itr_find == channels_.end())
+        return false;
+
+    auto& subscribers = itr_find->second;
+    auto itr = std::find(subscribers.begin(), subscribers.end(), svc_handle);
+    if (itr == subscribers.end())
+        return false;
+
+    subscribers.erase(itr);
+
+    return true;
+}
+
+int service_multicast::publish(uint32_t src_svc_handle, uint32_t channel, void* data, size_t size)
+{
+    if ((size & MESSAGE_TYPE_MASK) != size)
+    {
+        delete[] (char*)data;
+        return -1;
+    }
+
+    // snapshot of subscribers
+    std::vector<uint32_t> subscribers;
+    {
+        std::shared_lock<std::shared_mutex> rlock(rw_mutex_);
+
+        auto itr_find = channels_.find(channel);
+        if (itr_find == channels_.end())
+        {
+            delete[] (char*)data;
+            return -1;
+        }
+        subscribers = itr_find->second;
+    }
+
+    if (subscribers.empty())
+    {
+        delete[] (char*)data;
+        return 0;
+    }
+
+    // hold a reference until all messages pushed
+    auto pkg = new multicast_package;
+    package_count_.fetch_add(1, std::memory_order_relaxed);
+    pkg->ref.store((int)subscribers.size() + 1);
+    pkg->channel = channel;
+    pkg->data = data;
+    pkg->size = size;
+
+    service_message msg;
+    msg.src_svc_handle = src_svc_handle;
+    msg.session_id = 0;
+    msg.data_ptr = pkg;
+    msg.data_size = size | ((size_t)SERVICE_MSG_TYPE_MULTICAST << MESSAGE_TYPE_SHIFT);
+
+    int count = 0;
+    std::vector<uint32_t> dead_subscribers;
+    for (auto svc_handle : subscribers)
+    {
+        if (service_manager::instance()->push_service_message(svc_handle, &msg) == 0)
+        {
+            ++count;
+        }
+        else
+        {
+            release_package(pkg);
+            dead_subscribers.push_back(svc_handle);
+        }
+    }
+    release_package(pkg);
+
+    // the subscriber service has exited, remove it
+    for (auto svc_handle : dead_subscribers)
+    {
+        unsubscribe(channel, svc_handle);
+    }
+
+    return count;
+}
+
+void service_multicast::release_package(multicast_package* pkg)
+{
+    if (pkg->ref.fetch_sub(1) == 1)
+    {
+        delete[] (char*)pkg->data;
+        delete pkg;
+        package_count_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+int service_multicast::package_count()
+{
+    return package_count_.load(std::memory_order_relaxed);
+}
+
+}
+
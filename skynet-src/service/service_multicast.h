@@ -0,0 +1,76 @@
+/**
+ * multicast channel
+ *
+ * 1) a service creates a channel, other services subscribe it.
+ * 2) publish once, all subscribers receive a SERVICE_MSG_TYPE_MULTICAST message which refers to the same package,
+ *    the payload is immutable and is not copied per subscriber.
+ * 3) the package is reference counted, freed when the last subscriber has handled (or dropped) the message.
+ *
+ * the multicast message: data_ptr - multicast_package*, data_size - payload size.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <atomic>
+#include <shared_mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace skynet {
+
+// multicast package (shared by all subscribers)
+struct multicast_package
+{
+    std::atomic<int> ref { 0 };                             // reference count
+    uint32_t channel = 0;                                   // channel id
+    void* data = nullptr;                                   // payload (immutable)
+    size_t size = 0;                                        // payload size
+};
+
+// multicast channel manager
+class service_multicast final
+{
+private:
+    static service_multicast* instance_;
+public:
+    static service_multicast* instance();
+
+private:
+    static std::atomic<int> package_count_;                             // live packages (stat)
+
+    std::shared_mutex rw_mutex_;                                        // protect channels_
+    uint32_t channel_seed_ = 0;                                         // channel id seed
+    std::unordered_map<uint32_t, std::vector<uint32_t>> channels_;      // channel id -> subscriber service handles
+
+public:
+    // create a channel, return channel id
+    uint32_t new_channel();
+    // delete a channel
+    bool delete_channel(uint32_t channel);
+
+    // subscribe/unsubscribe a channel
+    bool subscribe(uint32_t channel, uint32_t svc_handle);
+    bool unsubscribe(uint32_t channel, uint32_t svc_handle);
+
+    /**
+     * publish a message to all subscribers of the channel
+     *
+     * @param src_svc_handle source service handle
+     * @param channel channel id
+     * @param data payload, take the ownership (allocated by new[])
+     * @param size payload size
+     * @return the number of subscribers received, -1 if channel not exists or message is too large
+     */
+    int publish(uint32_t src_svc_handle, uint32_t channel, void* data, size_t size);
+
+    // release a reference of the package (called by subscriber after handled the message)
+    static void release_package(multicast_package* pkg);
+
+    // number of packages not released by all subscribers yet
+    static int package_count();
+};
+
+}
+
@@ -0,0 +1,34 @@
+#include "service_name_cache.h"
+
+namespace skynet {
+
+uint32_t service_name_cache::find(const char* name) const
+{
+    auto iter = handles_.find(std::string_view(name));
+    if (iter == handles_.end())
+        return 0;
+
+    return iter->second;
+}
+
+void service_name_cache::insert(const char* name, uint32_t svc_handle)
+{
+    if (handles_.find(std::string_view(name)) != handles_.end())
+        return;
+
+    names_.emplace_front(name);
+    handles_.emplace(names_.front(), svc_handle);
+}
+
+size_t service_name_cache::size() const
+{
+    return handles_.size();
+}
+
+void service_name_cache::clear()
+{
+    handles_.clear();
+    names_.clear();
+}
+
+}
@@ -0,0 +1,34 @@
+/**
+ * name -> handle cache of a service (owner thread only, see service_manager::find_by_name)
+ *
+ * the map is keyed by string_view over the names it owns, a lookup by const char* doesn't build a std::string,
+ * so it never allocates (C++17 unordered_map has no transparent lookup).
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <forward_list>
+#include <unordered_map>
+
+namespace skynet {
+
+class service_name_cache final
+{
+private:
+    std::unordered_map<std::string_view, uint32_t> handles_;    // name (view of names_) -> service handle
+    std::forward_list<std::string> names_;                      // owns the names, a node never moves
+
+public:
+    // find a cached name, return 0 if not cached
+    uint32_t find(const char* name) const;
+    // cache a name
+    void insert(const char* name, uint32_t svc_handle);
+
+    size_t size() const;
+    void clear();
+};
+
+}
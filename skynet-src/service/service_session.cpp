@@ -0,0 +1,178 @@
+#include "service_session.h"
+#include "service_context.h"
+
+#include "../mq/mq_msg.h"
+
+#include "../timer/timer_manager.h"
+
+#include <cstring>
+
+namespace skynet {
+
+// the payload of the error delivered at the call deadline (tells the caller the call is timeout, see skynet.timed_call)
+static const char DEADLINE_PAYLOAD[] = "timeout";
+
+service_session::~service_session()
+{
+    for (auto& itr : calls_)
+    {
+        if (!itr.second.is_expired)
+            _release_call(itr.second);
+    }
+}
+
+void service_session::track(uint32_t svc_handle, int session_id, service_context* dst_svc_ctx)
+{
+    // the session is reused (wrapped around) while the old call is still outstanding, replace it
+    auto itr = calls_.find(session_id);
+    if (itr != calls_.end())
+    {
+        if (itr->second.is_expired)
+        {
+            --expired_count_;
+        }
+        else
+        {
+            --pending_count_;
+            _release_call(itr->second);
+        }
+    }
+
+    dst_svc_ctx->call_inbound_->fetch_add(1, std::memory_order_relaxed);
+    calls_[session_id] = { dst_svc_ctx->svc_handle_, dst_svc_ctx->call_inbound_, false };
+    ++pending_count_;
+
+    if (call_timeout_ > 0)
+    {
+        timer_manager::instance()->deadline(svc_handle, call_timeout_, session_id);
+    }
+}
+
+bool service_session::on_dispatch(service_message* msg)
+{
+    int svc_msg_type = msg->data_size >> MESSAGE_TYPE_SHIFT;
+    if (svc_msg_type != SERVICE_MSG_TYPE_RESPONSE && svc_msg_type != SERVICE_MSG_TYPE_ERROR)
+        return true;
+
+    // the deadline of a call (see timer_manager::deadline)
+    bool is_deadline = msg->is_deadline;
+
+    // down notification of a service
+    if (msg->session_id == 0)
+    {
+        if (svc_msg_type == SERVICE_MSG_TYPE_ERROR && !calls_.empty())
+            _release_callee(msg->src_svc_handle);
+        return true;
+    }
+
+    // no outstanding call (timer, ...)
+    if (calls_.empty())
+        return !is_deadline;
+
+    auto itr = calls_.find(msg->session_id);
+    // not a call (timer, ...), or the deadline of a call already finished
+    if (itr == calls_.end())
+        return !is_deadline;
+
+    call_info& info = itr->second;
+    if (is_deadline)
+    {
+        if (info.is_expired)
+            return false;
+
+        // deliver the error from the callee with the timeout marker, keep the entry to drop the late response
+        info.is_expired = true;
+        msg->src_svc_handle = info.dst_svc_handle;
+        ::memcpy(msg->inline_data, DEADLINE_PAYLOAD, sizeof(DEADLINE_PAYLOAD));
+        msg->data_ptr = msg->inline_data;
+        msg->data_size = ((size_t)SERVICE_MSG_TYPE_ERROR << MESSAGE_TYPE_SHIFT) | (sizeof(DEADLINE_PAYLOAD) - 1);
+        msg->is_inline = true;
+        ++expired_count_;
+        --pending_count_;
+        ++timeout_count_;
+        _release_call(info);
+
+        if (expired_count_ > EXPIRED_MAX)
+            _purge_expired();
+
+        return true;
+    }
+
+    // late response of an expired call
+    if (info.is_expired)
+    {
+        --expired_count_;
+        calls_.erase(itr);
+        return false;
+    }
+
+    --pending_count_;
+    _release_call(info);
+    calls_.erase(itr);
+
+    return true;
+}
+
+int service_session::set_call_timeout(int ticks)
+{
+    int prev = call_timeout_;
+    call_timeout_ = ticks > 0 ? ticks : 0;
+
+    return prev;
+}
+
+int service_session::pending_count()
+{
+    return pending_count_.load(std::memory_order_relaxed);
+}
+
+uint64_t service_session::timeout_count()
+{
+    return timeout_count_.load(std::memory_order_relaxed);
+}
+
+void service_session::_release_call(call_info& info)
+{
+    info.dst_inbound->fetch_sub(1, std::memory_order_relaxed);
+    info.dst_inbound.reset();
+}
+
+void service_session::_release_callee(uint32_t dst_svc_handle)
+{
+    for (auto itr = calls_.begin(); itr != calls_.end();)
+    {
+        if (itr->second.dst_svc_handle != dst_svc_handle)
+        {
+            ++itr;
+            continue;
+        }
+
+        if (itr->second.is_expired)
+        {
+            --expired_count_;
+        }
+        else
+        {
+            --pending_count_;
+        }
+        itr = calls_.erase(itr);
+    }
+}
+
+void service_session::_purge_expired()
+{
+    for (auto itr = calls_.begin(); itr != calls_.end();)
+    {
+        if (itr->second.is_expired)
+        {
+            itr = calls_.erase(itr);
+        }
+        else
+        {
+            ++itr;
+        }
+    }
+    expired_count_ = 0;
+}
+
+}
@@ -0,0 +1,77 @@
+/**
+ * outstanding call sessions of a service (owner thread only, except the counters)
+ *
+ * 1) a call (a request with an allocated session) is tracked from send until its response (or error) is dispatched.
+ * 2) optional deadline (call timeout): the timer delivers an error marked is_deadline to the caller at the deadline,
+ *    the caller gets the error from the callee address with the payload "timeout", the entry is marked expired and its late response is dropped.
+ * 3) entries of a dead callee are released by its down notification (error with session 0).
+ * 4) outstanding calls are counted per caller (pending_count) and per callee (service_context::call_inbound_),
+ *    the callee count is an overload signal readable by any service. the entry keeps the callee counter,
+ *    so the response releases it without a handle lookup.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <unordered_map>
+
+namespace skynet {
+
+// forward declare
+struct service_message;
+class service_context;
+
+class service_session final
+{
+private:
+    // constants
+    enum
+    {
+        EXPIRED_MAX = 1024,                                 // max expired entries waiting for the late response, purged when exceeded
+    };
+
+    // outstanding call
+    struct call_info
+    {
+        uint32_t dst_svc_handle = 0;                        // callee
+        std::shared_ptr<std::atomic<int>> dst_inbound;      // callee inbound count (service_context::call_inbound_)
+        bool is_expired = false;                            // deadline reached, waiting for the late response
+    };
+
+private:
+    std::unordered_map<int, call_info> calls_;              // key: session id
+    int expired_count_ = 0;                                 // expired entries in calls_
+    int call_timeout_ = 0;                                  // deadline of new calls (ticks, 1 tick = 10ms), 0: no deadline
+
+    // stat (written by owner, read by any thread)
+    std::atomic<int> pending_count_ { 0 };                  // outstanding calls (not expired)
+    std::atomic<uint64_t> timeout_count_ { 0 };             // number of calls expired
+
+public:
+    ~service_session();
+
+public:
+    // track a call sent to the callee (grabbed by sender), increase the callee inbound count, start its deadline timer
+    void track(uint32_t svc_handle, int session_id, service_context* dst_svc_ctx);
+    // check a message before dispatch, return false if it should be dropped (late response, stale deadline)
+    bool on_dispatch(service_message* msg);
+
+    // deadline of new calls (ticks), return the previous one
+    int set_call_timeout(int ticks);
+
+    // stat
+    int pending_count();
+    uint64_t timeout_count();
+
+private:
+    // the call is no longer outstanding, decrease the callee inbound count
+    static void _release_call(call_info& info);
+    // callee is down, release its entries
+    void _release_callee(uint32_t dst_svc_handle);
+    // drop the expired entries (the late responses are dispatched as unknown response)
+    void _purge_expired();
+};
+
+}
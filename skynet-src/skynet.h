@@ -34,6 +34,10 @@
 #include "service/service_manager.h"
 #include "service/service_command.h"
 
+// multicast api:
+// service_multicast::instance()->publish();
+#include "service/service_multicast.h"
+
 // socket api
 // node_socket::instance()->
 #include "node/node_socket.h"
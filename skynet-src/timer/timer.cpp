@@ -2,6 +2,11 @@
 
 namespace skynet {
 
+// submit shard of current thread (-1: not assigned)
+static thread_local int tls_submit_shard = -1;
+// round robin shard assignment
+static std::atomic<uint32_t> submit_shard_seq { 0 };
+
 // 添加一个定时器结点
 void add_node(timer* T, timer_node* node)
 {
@@ -45,6 +50,51 @@ void link(link_list* list, timer_node* node)
     node->next = nullptr;
 }
 
+void submit_node(timer* T, timer_node* node)
+{
+    if (tls_submit_shard < 0)
+        tls_submit_shard = (int)(submit_shard_seq.fetch_add(1, std::memory_order_relaxed) & SUBMIT_SHARD_MASK);
+
+    // push to the shard head
+    std::atomic<timer_node*>& head = T->submits[tls_submit_shard].head;
+    timer_node* next = head.load(std::memory_order_relaxed);
+    do
+    {
+        node->next = next;
+    } while (!head.compare_exchange_weak(next, node, std::memory_order_release, std::memory_order_relaxed));
+}
+
+void drain_submits(timer* T)
+{
+    for (auto& submit : T->submits)
+    {
+        // cheap check first, most shards are empty
+        if (submit.head.load(std::memory_order_relaxed) == nullptr)
+            continue;
+
+        // take all, no ABA (nodes are never popped one by one)
+        timer_node* current = submit.head.exchange(nullptr, std::memory_order_acquire);
+
+        // the stack is LIFO, reverse to keep the submit order of the thread
+        timer_node* list = nullptr;
+        while (current != nullptr)
+        {
+            timer_node* temp = current->next;
+            current->next = list;
+            list = current;
+            current = temp;
+        }
+
+        while (list != nullptr)
+        {
+            timer_node* temp = list->next;
+            list->expire += T->time;
+            add_node(T, list);
+            list = temp;
+        }
+    }
+}
+
 void move_list(timer* T, int level, int idx)
 {
     timer_node* current = link_clear(&T->t[level][idx]);
@@ -1,7 +1,7 @@
 #pragma once
 
 #include <cstdint>
-#include <mutex>
+#include <atomic>
 
 namespace skynet {
 
@@ -17,6 +17,11 @@ enum
     TIME_LEVEL = (1 << TIME_LEVEL_SHIFT),       // 2^6
     TIME_NEAR_MASK = (TIME_NEAR - 1),           // 2^8 - 1
     TIME_LEVEL_MASK = (TIME_LEVEL - 1),         // 2^6 - 1
+
+    // 定时器提交队列, 每个线程固定使用其中一个 (轮流分配), 避免提交线程争用同一个缓存行
+    SUBMIT_SHARD = 32,                          // power of 2
+    SUBMIT_SHARD_MASK = (SUBMIT_SHARD - 1),     //
+    CACHE_LINE_SIZE = 64,                       //
 };
 
 
@@ -34,6 +39,12 @@ struct link_list
     timer_node* tail = nullptr;                //
 };
 
+// 定时器提交队列 (lock-free stack, 多个线程提交, 定时器线程一次取走全部)
+struct alignas(CACHE_LINE_SIZE) submit_list
+{
+    std::atomic<timer_node*> head { nullptr };  // expire: ticks from the submit time, converted when drained
+};
+
 // 有四个级别的定时器数组，这些数组在timer_shift中被不断地重新调整优先级，
 // 直到移动到near数组中。四个级别分别是0，1，2，3，级别越大，expire也就越大，也就是超时时间越大
 
@@ -41,9 +52,9 @@ struct link_list
 struct timer
 {
     link_list near[TIME_NEAR];                  // 临近的定时器数组
-    link_list t[4][TIME_LEVEL];                 // 四个级别的定时器数组
+    link_list t[4][TIME_LEVEL];                 // 四个级别的定时器数组 (only the timer thread accesses the wheel)
 
-    std::mutex mutex;
+    submit_list submits[SUBMIT_SHARD];          // 定时器提交队列, drained by the timer thread each tick
 
     uint32_t time = 0;                          // 启动到现在走过的滴答数，等同于current
     uint32_t start_seconds = 0;                 // the number of seconds since the skynet node started. (seconds)
@@ -56,6 +67,10 @@ timer_node* link_clear(link_list* list);
 void link(link_list* list, timer_node* node);
 void move_list(timer* T, int level, int idx);
 void add_node(timer* T, timer_node* node);
+// submit a node (any thread), expire: ticks from now
+void submit_node(timer* T, timer_node* node);
+// drain the submitted nodes into the wheel (timer thread)
+void drain_submits(timer* T);
 
 }
 
@@ -32,6 +32,8 @@
 #include "../service/service_context.h"
 #include "../service/service_manager.h"
 
+#include "../node/node_record.h"
+
 #include "../utils/time_helper.h"
 
 #include <ctime>
@@ -52,6 +54,8 @@ struct timer_event
 
     int session;                        // a self increasing id. todo: check this, this means context call session_id?
                                         // when overflowing, restart with 1, so don't set a timer that takes a long time.
+
+    bool is_deadline;                   // call deadline, deliver an error message
 };
 
 // create a timer
@@ -77,17 +81,14 @@ static timer* create_timer()
     return r;
 }
 
-// add a timer
+// add a timer (lock free, the node is added to the wheel by the timer thread in next update)
 static void timer_add(timer* t, void* arg, size_t sz, int time)
 {
      timer_node* node = (timer_node*) new char[sizeof(timer_node) + sz];
      ::memcpy(node + 1, arg, sz);
 
-     //
-     std::lock_guard<std::mutex> lock(t->mutex);
-
-     node->expire = time + t->time;
-     add_node(t, node);
+     node->expire = time;
+     submit_node(t, node);
 }
 
 // 重新分配定时器所在区间
@@ -136,7 +137,14 @@ static inline void dispatch_list(timer_node* current)
         msg.src_svc_handle = 0;
         msg.session_id = event->session;
         msg.data_ptr = nullptr;
-        msg.data_size = (size_t)SERVICE_MSG_TYPE_RESPONSE << MESSAGE_TYPE_SHIFT;
+        msg.data_size = (size_t)(event->is_deadline ? SERVICE_MSG_TYPE_ERROR : SERVICE_MSG_TYPE_RESPONSE) << MESSAGE_TYPE_SHIFT;
+        msg.is_deadline = event->is_deadline;
+
+        // record the expiration
+        if (!event->is_deadline && node_record::instance()->is_recording())
+        {
+            node_record::instance()->record_timer(event->svc_handle, event->session);
+        }
 
         service_manager::instance()->push_service_message(event->svc_handle, &msg);
 
@@ -155,19 +163,15 @@ static inline void timer_execute(timer* T)
     {
         timer_node* current = link_clear(&T->near[idx]);
 
-        T->mutex.unlock();
-
-        // dispatch_list don't need lock T
         dispatch_list(current);
-
-        T->mutex.lock();
     }
 }
 
-// 更新定时器
+// 更新定时器 (timer thread only, no lock)
 static void timer_update(timer* T)
 {
-    T->mutex.lock();
+    // add the submitted timers, expire from the current time (same as adding them to the wheel directly)
+    drain_submits(T);
 
     // try to dispatch timeout 0 (rare condition)
     timer_execute(T);
@@ -175,8 +179,6 @@ static void timer_update(timer* T)
     timer_shift(T);
     //
     timer_execute(T);
-
-    T->mutex.unlock();
 }
 
 // 获取当前系统时间 (tick: 1 tick = 10ms)
@@ -229,18 +231,36 @@ int timer_manager::timeout(uint32_t svc_handle, int time, int session_id)
             return -1;
         }
     }
+    // replay: the timer expires by the recorded expiration (see node_record)
+    else if (node_record::instance()->is_replaying())
+    {
+        if (node_record::instance()->replay_timeout(svc_handle, session_id))
+        {
+            return timeout(svc_handle, 0, session_id);
+        }
+    }
     // execute regularly, add a timer node
     else
     {
         timer_event event;
         event.svc_handle = svc_handle;
         event.session = session_id;
+        event.is_deadline = false;
         timer_add(TI_, &event, sizeof(event), time);
     }
 
     return session_id;
 }
 
+void timer_manager::deadline(uint32_t svc_handle, int time, int session_id)
+{
+    timer_event event;
+    event.svc_handle = svc_handle;
+    event.session = session_id;
+    event.is_deadline = true;
+    timer_add(TI_, &event, sizeof(event), time);
+}
+
 // 刷新进程时间, 在定时器线程中定期执行, 执行频率: 2.5ms
 void timer_manager::update_time()
 {
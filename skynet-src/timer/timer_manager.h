@@ -12,7 +12,8 @@ struct timer;
  * skynet node timer manager
  *
  * 1) timer precision: 10ms. it means 1 tick = 10ms.
- * 2)
+ * 2) timeout/deadline don't lock: the timer node is pushed to a submit list of the calling thread,
+ *    the timer thread drains the submit lists into the wheel at the beginning of each tick (the wheel is owned by the timer thread).
  *
  * TODO: MOVE this module to net, use io_service schedule.
  */
@@ -47,6 +48,9 @@ public:
      */
     int timeout(uint32_t svc_handle, int time, int session_id);
 
+    // call deadline: deliver an error (source 0) of the call session after time ticks (see service_session)
+    void deadline(uint32_t svc_handle, int time, int session_id);
+
     // the number of ticks since the skynet node started. (ticks, 1 tick = 10ms)
     uint64_t now_ticks();
     // the number of seconds since the skynet node started. (seconds)
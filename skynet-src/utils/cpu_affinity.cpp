@@ -0,0 +1,183 @@
+#include "cpu_affinity.h"
+
+#include <cstdio>
+#include <cstdlib>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <dirent.h>
+#endif
+
+namespace skynet {
+
+bool cpu_affinity::parse(const char* cpu_list, std::vector<int>& cpus)
+{
+    cpus.clear();
+    if (cpu_list == nullptr)
+        return true;
+
+    const char* p = cpu_list;
+    while (*p != '\0')
+    {
+        // separator
+        if (*p == ',' || *p == ' ')
+        {
+            ++p;
+            continue;
+        }
+
+        // cpu or cpu range
+        char* end = nullptr;
+        long first = ::strtol(p, &end, 10);
+        if (end == p || first < 0)
+            return false;
+
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = ::strtol(p + 1, &end, 10);
+            if (end == p + 1 || last < first)
+                return false;
+            p = end;
+        }
+
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            cpus.push_back((int)cpu);
+        }
+    }
+
+    return true;
+}
+
+bool cpu_affinity::bind(std::thread& thread, const std::vector<int>& cpus)
+{
+    if (cpus.empty())
+        return false;
+
+#ifdef __linux__
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int cpu : cpus)
+    {
+        if (cpu < CPU_SETSIZE)
+            CPU_SET(cpu, &cpu_set);
+    }
+
+    return ::pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set), &cpu_set) == 0;
+#else
+    return false;
+#endif
+}
+
+int cpu_affinity::cpu_count()
+{
+#ifdef __linux__
+    return (int)::sysconf(_SC_NPROCESSORS_ONLN);
+#else
+    return (int)std::thread::hardware_concurrency();
+#endif
+}
+
+int cpu_affinity::numa_node(int cpu)
+{
+#ifdef __linux__
+    // /sys/devices/system/cpu/cpuN/nodeM
+    char path[64] = { 0 };
+    ::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR* dir = ::opendir(path);
+    if (dir == nullptr)
+        return -1;
+
+    int node = -1;
+    struct dirent* entry = nullptr;
+    while ((entry = ::readdir(dir)) != nullptr)
+    {
+        if (::sscanf(entry->d_name, "node%d", &node) == 1)
+            break;
+        node = -1;
+    }
+    ::closedir(dir);
+
+    return node;
+#else
+    return -1;
+#endif
+}
+
+std::string cpu_affinity::to_string(const std::vector<int>& cpus)
+{
+    if (cpus.empty())
+        return "any";
+
+    std::string str;
+    for (size_t i = 0; i < cpus.size(); i++)
+    {
+        int node = numa_node(cpus[i]);
+        str += std::to_string(cpus[i]);
+
+        // the last cpu of the node
+        if (i + 1 == cpus.size() || numa_node(cpus[i + 1]) != node)
+        {
+            str += node >= 0 ? "(node " + std::to_string(node) + ")" : "";
+            if (i + 1 != cpus.size())
+                str += " ";
+        }
+        else
+        {
+            str += ",";
+        }
+    }
+
+    return str;
+}
+
+std::string cpu_affinity::topology()
+{
+    int count = cpu_count();
+    std::string str = std::to_string(count) + " cpus";
+
+    // group by numa node, cpu ranges of each node
+    std::vector<std::string> nodes;
+    std::vector<int> range_last;
+    for (int cpu = 0; cpu < count; cpu++)
+    {
+        int node = numa_node(cpu);
+        if (node < 0)
+            continue;
+
+        if (node >= (int)nodes.size())
+        {
+            nodes.resize(node + 1);
+            range_last.resize(node + 1, -2);
+        }
+
+        auto& s = nodes[node];
+        if (range_last[node] == cpu - 1)
+        {
+            // extend range
+            size_t pos = s.find_last_of(",-");
+            if (pos != std::string::npos && s[pos] == '-')
+                s.erase(pos);
+            s += "-" + std::to_string(cpu);
+        }
+        else
+        {
+            s += (s.empty() ? "" : ",") + std::to_string(cpu);
+        }
+        range_last[node] = cpu;
+    }
+
+    for (size_t node = 0; node < nodes.size(); node++)
+    {
+        if (!nodes[node].empty())
+            str += ", node " + std::to_string(node) + ": " + nodes[node];
+    }
+
+    return str;
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace skynet {
+
+/**
+ * cpu affinity utils
+ * linux only (pthread_setaffinity_np & sysfs topology), others: no effect.
+ */
+class cpu_affinity final
+{
+public:
+    /**
+     * parse cpu list, e.g. "0-3,8,10-11"
+     *
+     * @param cpu_list cpu list string (empty: no affinity)
+     * @param cpus output cpu ids
+     * @return false if the cpu list is invalid
+     */
+    static bool parse(const char* cpu_list, std::vector<int>& cpus);
+
+    // bind the thread to the cpus, return false if failed (or not supported)
+    static bool bind(std::thread& thread, const std::vector<int>& cpus);
+
+    // number of online cpus
+    static int cpu_count();
+    // numa node of the cpu, -1 if unknown
+    static int numa_node(int cpu);
+
+    // cpu list string with numa node, e.g. "0,1(node 0) 8(node 1)", "any" if empty
+    static std::string to_string(const std::vector<int>& cpus);
+    // cpu topology string, e.g. "16 cpus, node 0: 0-7, node 1: 8-15"
+    static std::string topology();
+};
+
+}
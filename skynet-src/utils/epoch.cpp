@@ -0,0 +1,158 @@
+#include "epoch.h"
+
+#include <cassert>
+#include <thread>
+
+namespace skynet {
+
+epoch* epoch::instance_ = nullptr;
+
+epoch* epoch::instance()
+{
+    static std::once_flag oc;
+    std::call_once(oc, [&](){ instance_ = new epoch; });
+
+    return instance_;
+}
+
+// thread local reader state, the slot is given back when the thread exits
+struct epoch_thread_state
+{
+    void* slot = nullptr;                                   // epoch::reader_slot
+    int depth = 0;                                          // nested pin count
+    std::atomic<bool>* is_used = nullptr;                   //
+
+    ~epoch_thread_state()
+    {
+        if (is_used != nullptr)
+            is_used->store(false, std::memory_order_release);
+    }
+};
+
+static thread_local epoch_thread_state t_state;
+
+epoch::reader_slot* epoch::_slot()
+{
+    if (t_state.slot != nullptr)
+        return static_cast<reader_slot*>(t_state.slot);
+
+    for (;;)
+    {
+        for (int i = 0; i < SLOT_MAX; i++)
+        {
+            bool expected = false;
+            if (slots_[i].is_used.load(std::memory_order_relaxed) || !slots_[i].is_used.compare_exchange_strong(expected, true))
+                continue;
+
+            // extend the scan range
+            int count = slot_count_.load();
+            while (count < i + 1 && !slot_count_.compare_exchange_weak(count, i + 1));
+
+            t_state.slot = &slots_[i];
+            t_state.is_used = &slots_[i].is_used;
+            return &slots_[i];
+        }
+
+        // all slots are used, wait a thread exits
+        std::this_thread::yield();
+    }
+}
+
+void epoch::pin()
+{
+    reader_slot* slot = _slot();
+    if (t_state.depth++ > 0)
+        return;
+
+    slot->epoch.store(global_epoch_.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // the pinned epoch must be visible before the shared pointers are loaded
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void epoch::unpin()
+{
+    assert(t_state.depth > 0);
+    if (--t_state.depth > 0)
+        return;
+
+    static_cast<reader_slot*>(t_state.slot)->epoch.store(0, std::memory_order_release);
+}
+
+void epoch::retire(void* ptr, deleter_proc deleter)
+{
+    std::vector<retired_object> frees;
+
+    {
+        std::lock_guard<std::mutex> lock(retire_mutex_);
+
+        // the object has been unlinked before this point
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        retired_.push_back({ ptr, deleter, global_epoch_.load(std::memory_order_relaxed) });
+        retired_count_.store((int)retired_.size(), std::memory_order_relaxed);
+
+        if (retired_.size() >= COLLECT_THRESHOLD)
+            _advance(frees);
+    }
+
+    // deleters may retire objects too, so free out of lock
+    for (auto& obj : frees)
+        obj.deleter(obj.ptr);
+}
+
+void epoch::collect()
+{
+    if (retired_count_.load(std::memory_order_relaxed) == 0)
+        return;
+
+    std::vector<retired_object> frees;
+
+    {
+        std::lock_guard<std::mutex> lock(retire_mutex_);
+        _advance(frees);
+    }
+
+    for (auto& obj : frees)
+        obj.deleter(obj.ptr);
+}
+
+int epoch::pending()
+{
+    return retired_count_.load(std::memory_order_relaxed);
+}
+
+void epoch::_advance(std::vector<retired_object>& frees)
+{
+    uint64_t cur_epoch = global_epoch_.load(std::memory_order_relaxed);
+
+    // the readers pinned in an older epoch may still see the objects retired then
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    bool can_advance = true;
+    int count = slot_count_.load();
+    for (int i = 0; i < count; i++)
+    {
+        uint64_t slot_epoch = slots_[i].epoch.load(std::memory_order_acquire);
+        if (slot_epoch != 0 && slot_epoch != cur_epoch)
+        {
+            can_advance = false;
+            break;
+        }
+    }
+    if (can_advance)
+    {
+        global_epoch_.store(++cur_epoch, std::memory_order_release);
+    }
+
+    // retired 2 epochs ago, no reader can see it
+    size_t j = 0;
+    for (size_t i = 0; i < retired_.size(); i++)
+    {
+        if (retired_[i].epoch + 2 <= cur_epoch)
+            frees.push_back(retired_[i]);
+        else
+            retired_[j++] = retired_[i];
+    }
+    retired_.resize(j);
+    retired_count_.store((int)j, std::memory_order_relaxed);
+}
+
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstdint>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace skynet {
+
+/**
+ * epoch based memory reclamation (readers never wait)
+ *
+ * 1) a reader pins the current epoch before loading shared pointers, and unpins after use (see epoch_guard).
+ * 2) a writer unlinks an object and retires it, the object is freed after the global epoch has advanced twice,
+ *    so every reader which might have seen it has unpinned.
+ * 3) the global epoch advances (collect) only when all pinned readers are in the current epoch.
+ *    collect is called when retired objects pile up, and periodically by the timer thread.
+ * 4) each thread owns a reader slot (taken on first pin, given back when the thread exits).
+ */
+class epoch final
+{
+private:
+    static epoch* instance_;
+public:
+    static epoch* instance();
+
+public:
+    // object deleter
+    typedef void (*deleter_proc)(void* ptr);
+
+private:
+    // constants
+    enum
+    {
+        SLOT_MAX = 1024,                                    // max threads pinned at the same time
+        COLLECT_THRESHOLD = 64,                             // collect when retired objects pile up
+    };
+
+    // reader slot, one per thread (cache line aligned, written by its thread only)
+    struct alignas(64) reader_slot
+    {
+        std::atomic<uint64_t> epoch { 0 };                  // pinned epoch, 0: not pinned
+        std::atomic<bool> is_used { false };                // owned by a thread
+    };
+
+    // retired object
+    struct retired_object
+    {
+        void* ptr = nullptr;                                //
+        deleter_proc deleter = nullptr;                     //
+        uint64_t epoch = 0;                                 // global epoch when retired
+    };
+
+private:
+    reader_slot slots_[SLOT_MAX];                           //
+    std::atomic<int> slot_count_ { 0 };                     // slots ever used (scan range)
+    std::atomic<uint64_t> global_epoch_ { 1 };              //
+
+    std::mutex retire_mutex_;                               // protect retired_
+    std::vector<retired_object> retired_;                   // objects waiting for reclamation
+    std::atomic<int> retired_count_ { 0 };                  // size of retired_, check without lock
+
+public:
+    // enter a read side critical section (nested pin is allowed)
+    void pin();
+    // leave a read side critical section
+    void unpin();
+
+    // free the object when no reader can see it (the object must be unlinked already)
+    void retire(void* ptr, deleter_proc deleter);
+    // try to advance the global epoch, free the objects no reader can see
+    void collect();
+    // number of objects waiting for reclamation
+    int pending();
+
+private:
+    // reader slot of current thread
+    reader_slot* _slot();
+    // free the retired objects older than the epoch (lock by caller), return the objects to free
+    void _advance(std::vector<retired_object>& frees);
+};
+
+// pin the current epoch in a scope
+class epoch_guard final
+{
+public:
+    epoch_guard()
+    {
+        epoch::instance()->pin();
+    }
+    ~epoch_guard()
+    {
+        epoch::instance()->unpin();
+    }
+
+    epoch_guard(const epoch_guard&) = delete;
+    epoch_guard& operator=(const epoch_guard&) = delete;
+};
+
+}
@@ -0,0 +1,72 @@
+#include "parker.h"
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+namespace skynet {
+
+#ifdef __linux__
+
+static inline void futex_wait(std::atomic<int>* addr, int expected)
+{
+    ::syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+static inline void futex_wake(std::atomic<int>* addr, int count)
+{
+    ::syscall(SYS_futex, reinterpret_cast<int*>(addr), FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+}
+
+void parker::park()
+{
+    // consume the permit, or wait (spurious wakeup, retry)
+    while (state_.exchange(0) != 1)
+    {
+        futex_wait(&state_, 0);
+    }
+}
+
+void parker::unpark()
+{
+    if (state_.exchange(1) == 0)
+    {
+        futex_wake(&state_, 1);
+    }
+}
+
+#else
+
+void parker::park()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    cond_.wait(lock, [this] { return permit_; });
+    permit_ = false;
+}
+
+void parker::unpark()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    permit_ = true;
+    cond_.notify_one();
+}
+
+#endif
+
+void parker::cpu_relax()
+{
+#if defined(__x86_64__) || defined(__i386__)
+    _mm_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+}
+
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+
+#ifndef __linux__
+#include <mutex>
+#include <condition_variable>
+#endif
+
+namespace skynet {
+
+/**
+ * thread parker (one permit)
+ * park() blocks until a permit is available and consumes it, unpark() makes the permit available.
+ * linux: futex, others: mutex & condition variable.
+ */
+class parker final
+{
+private:
+#ifdef __linux__
+    std::atomic<int> state_ { 0 };                          // 1: permit available
+#else
+    std::mutex mutex_;                                      //
+    std::condition_variable cond_;                          //
+    bool permit_ = false;                                   // permit available
+#endif
+
+public:
+    parker() = default;
+    ~parker() = default;
+
+    parker(const parker&) = delete;
+    parker& operator=(const parker&) = delete;
+
+public:
+    // block current thread until unpark
+    void park();
+    // wakeup the parked thread (or the next park returns immediately)
+    void unpark();
+
+    // cpu hint in spin-wait loop
+    static void cpu_relax();
+};
+
+}
+
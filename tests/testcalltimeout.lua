@@ -0,0 +1,94 @@
+local skynet = require "skynet"
+
+local mode = ...
+
+if mode == "slave" then
+
+    skynet.start(function()
+        skynet.dispatch("lua", function(_, _, cmd, ti)
+            if cmd == "fail" then
+                skynet.response()(false)    -- the caller gets an ERROR message
+                return
+            end
+            if cmd == "slow" then
+                skynet.sleep(ti)
+            end
+            skynet.ret(skynet.pack(cmd))
+        end)
+    end)
+
+else
+
+    local function check(cond, what)
+        if not cond then
+            skynet.log_info("call timeout test FAILED: " .. what)
+            error(what)
+        end
+        skynet.log_info("call timeout test ok: " .. what)
+    end
+
+    skynet.start(function()
+        local slave = skynet.newservice(SERVICE_NAME, "slave")
+
+        -- deadline before the response
+        local t0 = skynet.now()
+        local ok, err = pcall(skynet.timed_call, 10, slave, "lua", "slow", 50)
+        local elapsed = skynet.now() - t0
+        check(not ok and err:find("call timeout", 1, true), "timed_call raises call timeout: " .. tostring(err))
+        check(elapsed >= 10 and elapsed < 50, "timed_call returns at the deadline: " .. elapsed)
+        check(skynet.stat "call_pending" == 0 and skynet.call_inbound(slave) == 0, "expired call released")
+        check(skynet.stat "call_timeout" == 1, "expired call counted")
+
+        -- the late response is dropped, the next call works
+        skynet.sleep(50)
+        check(skynet.call(slave, "lua", "fast") == "fast", "late response dropped")
+
+        -- response before the deadline
+        check(skynet.timed_call(100, slave, "lua", "slow", 5) == "slow", "timed_call returns the response")
+
+        -- other errors are not timeout
+        ok, err = pcall(skynet.timed_call, 100, slave, "lua", "fail")
+        check(not ok and err:find("call failed", 1, true), "error response raises call failed: " .. tostring(err))
+
+        -- outstanding calls are counted on both sides
+        local done = 0
+        for i = 1, 10 do
+            skynet.fork(function()
+                skynet.call(slave, "lua", "slow", 30)
+                done = done + 1
+            end)
+        end
+        skynet.sleep(5)
+        check(skynet.call_inbound(slave) == 10 and skynet.stat "call_pending" == 10, "outstanding calls counted")
+        skynet.sleep(40)
+        check(done == 10 and skynet.call_inbound(slave) == 0 and skynet.stat "call_pending" == 0, "responded calls released")
+
+        -- default deadline, the stale deadlines of the finished calls are dropped
+        skynet.call_timeout(20)
+        for i = 1, 1000 do
+            assert(skynet.call(slave, "lua", "fast") == "fast")
+        end
+        ok = pcall(skynet.call, slave, "lua", "slow", 100)
+        skynet.call_timeout(0)
+        skynet.sleep(30)
+        check(not ok and skynet.stat "call_timeout" == 2, "default deadline")
+
+        -- the callee exits with outstanding calls
+        local dead = skynet.newservice(SERVICE_NAME, "slave")
+        skynet.fork(function()
+            pcall(skynet.call, dead, "lua", "slow", 1000)
+        end)
+        skynet.sleep(5)
+        check(skynet.stat "call_pending" == 1, "call to the dying callee pending")
+        skynet.send(dead, "debug", "EXIT")
+        skynet.sleep(5)
+        check(skynet.stat "call_pending" == 0, "calls to the exited callee released")
+
+        -- a new service (may reuse the released context) starts with no inbound call
+        local fresh = skynet.newservice(SERVICE_NAME, "slave")
+        check(skynet.call_inbound(fresh) == 0, "new service inbound count")
+
+        skynet.exit()
+    end)
+
+end
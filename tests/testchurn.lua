@@ -0,0 +1,48 @@
+local skynet = require "skynet"
+require "skynet.manager"
+
+-- service churn benchmark: create & kill short-lived services, report the throughput
+-- usage: testchurn [count] [rounds]
+
+local mode, rounds = ...
+
+if mode == "agent" then
+
+    skynet.start(function()
+        skynet.dispatch("lua", function()
+            skynet.ret()
+        end)
+    end)
+
+else
+
+    local count = tonumber(mode) or 2000
+    rounds = tonumber(rounds) or 5
+
+    skynet.start(function()
+        for round = 1, rounds do
+            local t = skynet.hpc()
+            local agents = {}
+            for i = 1, count do
+                agents[i] = skynet.launch("snlua", SERVICE_NAME .. " agent")
+            end
+            -- wait all agents started
+            for i = 1, count do
+                skynet.call(agents[i], "lua")
+            end
+            local t_create = skynet.hpc() - t
+
+            t = skynet.hpc()
+            for i = 1, count do
+                skynet.kill(agents[i])
+            end
+            local t_kill = skynet.hpc() - t
+
+            skynet.log_info(string.format("churn round %d: %d services, create %.1f us/svc (%.0f/s), kill %.1f us/svc",
+                round, count, t_create / count / 1000, count * 1e9 / t_create, t_kill / count / 1000))
+            skynet.sleep(10)
+        end
+        skynet.log_info("churn done")
+    end)
+
+end
@@ -0,0 +1,157 @@
+local skynet = require "skynet"
+
+local mode = ...
+
+local WORK_COUNT = 200
+local SYSTEM_COUNT = 50
+
+skynet.register_svc_msg_handler {
+    msg_type_name = "system",
+    msg_type = skynet.SERVICE_MSG_TYPE_SYSTEM,
+    pack = skynet.pack,
+    unpack = skynet.unpack,
+}
+
+local function busy(ms)
+    local t = skynet.hpc()
+    while skynet.hpc() - t < ms * 1000000 do end
+end
+
+if mode == "echo" then
+
+    skynet.start(function()
+        skynet.dispatch("lua", function(_, _, cmd)
+            if cmd == "fail" then
+                skynet.response()(false)    -- the caller gets an ERROR message
+            else
+                skynet.ret()
+            end
+        end)
+    end)
+
+elseif mode == "shed" or mode == "defer" then
+
+    local echo
+    local dispatched = {}           -- work id -> dispatch times
+    local work_count = 0
+    local reply_count = 0           -- responses and errors of the calls to echo
+    local system_count = 0
+
+    local CMD = {}
+
+    -- hold the worker thread, the messages wait in the mailbox
+    function CMD.block(source)
+        skynet.send(source, "lua", "blocking")
+        busy(200)
+    end
+
+    function CMD.work(_, i)
+        dispatched[i] = (dispatched[i] or 0) + 1
+        work_count = work_count + 1
+        -- the response and the error wait in the mailbox too, they must not be dropped
+        skynet.fork(function()
+            pcall(skynet.call, echo, "lua", "ok")
+            reply_count = reply_count + 1
+        end)
+        skynet.fork(function()
+            pcall(skynet.call, echo, "lua", "fail")
+            reply_count = reply_count + 1
+        end)
+        busy(3)
+        skynet.ret()
+    end
+
+    function CMD.stat()
+        local twice = 0
+        for _, n in pairs(dispatched) do
+            if n > 1 then
+                twice = twice + 1
+            end
+        end
+        skynet.ret(skynet.pack(work_count, twice, reply_count, system_count, skynet.sojourn()))
+    end
+
+    skynet.start(function()
+        echo = skynet.newservice(SERVICE_NAME, "echo")
+        skynet.sojourn_policy(1, 20, mode, { skynet.SERVICE_MSG_TYPE_LUA })
+        skynet.dispatch("system", function()
+            system_count = system_count + 1
+        end)
+        skynet.dispatch("lua", function(_, source, cmd, ...)
+            CMD[cmd](source, ...)
+        end)
+    end)
+
+else
+
+    local blocking
+
+    local function check(cond, what)
+        if not cond then
+            skynet.log_info("codel test FAILED: " .. what)
+            error(what)
+        end
+        skynet.log_info("codel test ok: " .. what)
+    end
+
+    local function overload(policy)
+        local slave = skynet.newservice(SERVICE_NAME, policy)
+        blocking = coroutine.running()
+        skynet.send(slave, "lua", "block")
+        skynet.wait(blocking)
+
+        -- calls queued behind the block
+        local ok_count, fail_count, done = 0, 0, 0
+        local co = coroutine.running()
+        for i = 1, WORK_COUNT do
+            skynet.fork(function()
+                if pcall(skynet.call, slave, "lua", "work", i) then
+                    ok_count = ok_count + 1
+                else
+                    fail_count = fail_count + 1
+                end
+                done = done + 1
+                if done == WORK_COUNT then
+                    skynet.wakeup(co)
+                end
+            end)
+        end
+        -- system messages arrive while the queue stays above target
+        skynet.fork(function()
+            for i = 1, SYSTEM_COUNT do
+                skynet.send(slave, "system", i)
+                skynet.sleep(1)
+            end
+        end)
+        skynet.wait(co)
+        skynet.sleep(SYSTEM_COUNT + 10)
+
+        local work_count, twice, reply_count, system_count, sojourn = skynet.call(slave, "lua", "stat")
+        skynet.log_info(string.format("codel %s: ok=%d fail=%d shed=%d defer=%d", policy, ok_count, fail_count, sojourn.shed, sojourn.defer))
+
+        check(ok_count + fail_count == WORK_COUNT, policy .. ": every call returns")
+        check(fail_count == sojourn.shed and ok_count == work_count, policy .. ": shed calls get an error")
+        check(twice == 0, policy .. ": no message dispatched twice")
+        check(reply_count == 2 * work_count, policy .. ": responses and errors not dropped")
+        check(system_count == SYSTEM_COUNT, policy .. ": system messages not dropped")
+
+        return sojourn
+    end
+
+    skynet.start(function()
+        skynet.dispatch("lua", function(_, _, cmd)
+            assert(cmd == "blocking")
+            skynet.wakeup(blocking)
+        end)
+
+        local sojourn = overload("shed")
+        check(sojourn.shed > 0 and sojourn.defer == 0, "shed: messages shed")
+
+        -- a deferred message is shed if it's picked again, never deferred twice
+        sojourn = overload("defer")
+        check(sojourn.defer > 0 and sojourn.shed <= sojourn.defer, "defer: messages deferred once")
+
+        skynet.exit()
+    end)
+
+end
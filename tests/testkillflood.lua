@@ -0,0 +1,100 @@
+local skynet = require "skynet"
+require "skynet.manager"
+
+local mode = ...
+
+local ROUNDS = 50
+local VICTIM_COUNT = 4
+local FLOODER_COUNT = 4
+local FLOOD_COUNT = 2000
+
+if mode == "victim" then
+
+    local count = 0
+    skynet.start(function()
+        skynet.dispatch("lua", function(_, _, cmd)
+            if cmd == "count" then
+                skynet.ret(skynet.pack(count))
+            else
+                count = count + 1
+            end
+        end)
+    end)
+
+elseif mode == "flooder" then
+
+    -- send to the victims until done, they are killed in the middle
+    skynet.start(function()
+        skynet.dispatch("lua", function(_, _, victims, n)
+            for i = 1, n do
+                skynet.send(victims[i % #victims + 1], "lua", "flood", i)
+                if i % 100 == 0 then
+                    skynet.yield()
+                end
+            end
+            skynet.ret()
+        end)
+    end)
+
+else
+
+    local function check(cond, what)
+        if not cond then
+            skynet.log_info("kill flood test FAILED: " .. what)
+            error(what)
+        end
+        skynet.log_info("kill flood test ok: " .. what)
+    end
+
+    local function service_count()
+        local n = 0
+        for _ in pairs(skynet.stat_all()) do
+            n = n + 1
+        end
+        return n
+    end
+
+    skynet.start(function()
+        local flooders = {}
+        for i = 1, FLOODER_COUNT do
+            flooders[i] = skynet.newservice(SERVICE_NAME, "flooder")
+        end
+        local base_count = service_count()
+
+        -- kill the victims while their mailboxes are flooded, the mailboxes are released under the producers
+        for round = 1, ROUNDS do
+            local victims = {}
+            for i = 1, VICTIM_COUNT do
+                victims[i] = skynet.newservice(SERVICE_NAME, "victim")
+            end
+
+            local done = 0
+            local co = coroutine.running()
+            for i = 1, FLOODER_COUNT do
+                skynet.fork(function()
+                    skynet.call(flooders[i], "lua", victims, FLOOD_COUNT)
+                    done = done + 1
+                    if done == FLOODER_COUNT then
+                        skynet.wakeup(co)
+                    end
+                end)
+            end
+
+            skynet.yield()
+            for i = 1, VICTIM_COUNT do
+                skynet.kill(victims[i])
+            end
+            skynet.wait(co)
+        end
+        skynet.sleep(10)
+        check(service_count() == base_count, "killed services released")
+
+        -- the released mailboxes are reused
+        local victim = skynet.newservice(SERVICE_NAME, "victim")
+        skynet.call(flooders[1], "lua", { victim }, FLOOD_COUNT)
+        check(skynet.call(victim, "lua", "count") == FLOOD_COUNT, "reused mailbox delivers")
+
+        skynet.exit()
+    end)
+
+end
@@ -0,0 +1,108 @@
+local skynet = require "skynet"
+
+local mode, policy = ...
+
+local CAPACITY = 10
+local SEND_COUNT = 50
+
+if mode == "slave" then
+
+    local got = 0
+    local first                 -- the first message delivered
+
+    local CMD = {}
+
+    -- hold the worker thread, the messages pending in the mailbox
+    function CMD.block(source)
+        skynet.send(source, "lua", "blocking")
+        local t = skynet.hpc()
+        while skynet.hpc() - t < 200 * 1000000 do end
+    end
+
+    function CMD.count()
+        skynet.ret(skynet.pack(got, skynet.stat "reject", skynet.stat "drop", first))
+    end
+
+    function CMD.message(_, i)
+        got = got + 1
+        first = first or i
+    end
+
+    skynet.start(function()
+        skynet.mailbox(CAPACITY, policy)
+        skynet.dispatch("lua", function(_, source, cmd, ...)
+            CMD[cmd](source, ...)
+        end)
+    end)
+
+else
+
+    local blocking
+
+    local function check(cond, what)
+        if not cond then
+            skynet.log_info("mailbox test FAILED: " .. what)
+            error(what)
+        end
+        skynet.log_info("mailbox test ok: " .. what)
+    end
+
+    -- fill the mailbox of a blocked slave, return the send results
+    local function fill(policy)
+        local slave = skynet.newservice(SERVICE_NAME, "slave", policy)
+        blocking = coroutine.running()
+        skynet.send(slave, "lua", "block")
+        skynet.wait(blocking)
+
+        local accepted, throttled, errors = 0, 0, {}
+        for i = 1, SEND_COUNT do
+            local ok, err = skynet.send(slave, "lua", "message", i)
+            if ok then
+                accepted = accepted + 1
+                if err == "throttle" then
+                    throttled = throttled + 1
+                end
+            else
+                errors[err] = (errors[err] or 0) + 1
+            end
+        end
+
+        local len, cap = skynet.pressure(slave)
+        check(cap == CAPACITY, policy .. ": capacity " .. cap)
+
+        -- wait the slave drains the mailbox
+        skynet.sleep(50)
+
+        return slave, accepted, throttled, errors, len
+    end
+
+    skynet.start(function()
+        skynet.dispatch("lua", function(_, _, cmd)
+            assert(cmd == "blocking")
+            skynet.wakeup(blocking)
+        end)
+
+        -- reject: the sender gets false, "mailbox full" over the capacity
+        local slave, accepted, throttled, errors = fill("reject")
+        check(accepted == CAPACITY and errors["mailbox full"] == SEND_COUNT - CAPACITY, "reject: sends over capacity rejected")
+        local got, reject, drop = skynet.call(slave, "lua", "count")
+        check(got == CAPACITY and reject == SEND_COUNT - CAPACITY and drop == 0, "reject: stat")
+
+        -- drop oldest: accepted up to 2 * capacity (hard limit), trimmed to capacity at dispatch
+        slave, accepted, throttled, errors = fill("drop")
+        check(accepted == 2 * CAPACITY and errors["mailbox full"] == SEND_COUNT - 2 * CAPACITY, "drop: hard limit 2 * capacity")
+        local first
+        got, reject, drop, first = skynet.call(slave, "lua", "count")
+        check(got == CAPACITY and drop == CAPACITY and reject == SEND_COUNT - 2 * CAPACITY, "drop: trimmed to capacity at dispatch")
+        check(first == CAPACITY + 1, "drop: the oldest dropped")
+
+        -- throttle: all accepted, the sender is signaled over the capacity
+        slave, accepted, throttled, errors = fill("throttle")
+        check(accepted == SEND_COUNT and throttled == SEND_COUNT - CAPACITY, "throttle: sends over capacity signaled")
+        got, reject, drop = skynet.call(slave, "lua", "count")
+        check(got == SEND_COUNT and reject == 0 and drop == 0, "throttle: stat")
+
+        skynet.exit()
+    end)
+
+end
@@ -0,0 +1,119 @@
+local skynet = require "skynet"
+local multicast = require "skynet.multicast"
+require "skynet.manager"
+
+local mode = ...
+
+if mode == "sub" then
+
+    local received = 0
+
+    local CMD = {}
+
+    function CMD.subscribe(channel)
+        return multicast.subscribe(channel, function(_, _, n)
+            received = received + 1
+        end)
+    end
+
+    function CMD.unsubscribe(channel)
+        return multicast.unsubscribe(channel)
+    end
+
+    function CMD.count()
+        return received
+    end
+
+    -- hold the worker thread, the messages pending in the mailbox
+    function CMD.block(ms)
+        local t = skynet.hpc()
+        while skynet.hpc() - t < ms * 1000000 do end
+    end
+
+    skynet.start(function()
+        skynet.dispatch("lua", function(_, _, cmd, ...)
+            skynet.ret(skynet.pack(CMD[cmd](...)))
+        end)
+    end)
+
+elseif mode == "forward" then
+
+    -- forward mode, the multicast message is not in the map (released by skynet.trash)
+    local received = 0
+    skynet.forward_by_type({}, function()
+        skynet.dispatch("lua", function(_, _, cmd, channel)
+            if cmd == "subscribe" then
+                skynet.ret(skynet.pack(multicast.subscribe(channel, function()
+                    received = received + 1
+                end)))
+            else
+                skynet.ret(skynet.pack(received))
+            end
+        end)
+    end)
+
+else
+
+    local function check(cond, what)
+        if not cond then
+            skynet.log_info("multicast test FAILED: " .. what)
+            error(what)
+        end
+        skynet.log_info("multicast test ok: " .. what)
+    end
+
+    skynet.start(function()
+        local channel = multicast.new()
+
+        -- publish/subscribe
+        local subs = {}
+        for i = 1, 3 do
+            subs[i] = skynet.newservice(SERVICE_NAME, "sub")
+            assert(skynet.call(subs[i], "lua", "subscribe", channel))
+        end
+        for i = 1, 10 do
+            check(multicast.publish(channel, i) == 3, "publish to 3 subscribers")
+        end
+        skynet.sleep(10)
+        for i = 1, 3 do
+            check(skynet.call(subs[i], "lua", "count") == 10, "subscriber received 10")
+        end
+
+        -- unsubscribe
+        assert(skynet.call(subs[3], "lua", "unsubscribe", channel))
+        check(multicast.publish(channel, "after unsubscribe") == 2, "publish after unsubscribe")
+        skynet.sleep(10)
+        check(skynet.call(subs[3], "lua", "count") == 10, "unsubscribed service received nothing")
+
+        -- publish to an exited subscriber, it's removed from the channel
+        skynet.kill(subs[2])
+        check(multicast.publish(channel, "after exit") == 1, "publish skips the exited subscriber")
+        check(not require("skynet.multicast.core").unsubscribe(channel, subs[2]), "exited subscriber removed")
+
+        -- drop the pending messages of an exited subscriber
+        skynet.send(subs[1], "lua", "block", 100)
+        for i = 1, 100 do
+            multicast.publish(channel, i)
+        end
+        skynet.kill(subs[1])
+
+        -- forward mode subscriber
+        local fwd = skynet.newservice(SERVICE_NAME, "forward")
+        assert(skynet.call(fwd, "lua", "subscribe", channel))
+        for i = 1, 10 do
+            multicast.publish(channel, string.rep("x", 100))
+        end
+        skynet.sleep(10)
+        check(skynet.call(fwd, "lua", "count") == 10, "forward mode subscriber received 10")
+
+        -- every package is released (handled, dropped or trashed)
+        skynet.sleep(50)
+        check(multicast.packages() == 0, "all packages released")
+
+        multicast.delete(channel)
+        check(multicast.publish(channel, "deleted") == -1, "publish to deleted channel")
+
+        skynet.exit()
+    end)
+
+end